@@ -1,12 +1,38 @@
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <vector>
 #include <cmath>
+#include <cfloat>
 #include <string>
 #include <sstream>
 #include <ctime>
 #include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <algorithm>
-
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+
+// SIMD paths for batch vertex projection; a scalar loop covers everything else
+#if defined(__AVX__)
+#include <immintrin.h>
+#define HAS_AVX 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAS_SSE2 1
+#endif
+
+#ifdef _WIN32
 // Add these lines to prevent Windows.h min/max macros from interfering
 #undef min
 #undef max
@@ -16,6 +42,20 @@
 
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "gdi32.lib")
+#else
+// Headless build: the renderer only needs the Win32 color helpers
+#include <chrono>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef uint32_t COLORREF;
+#define RGB(r, g, b) ((COLORREF)(((uint8_t)(r)) | ((uint32_t)((uint8_t)(g)) << 8) | ((uint32_t)((uint8_t)(b)) << 16)))
+#define GetRValue(rgb) ((uint8_t)(rgb))
+#define GetGValue(rgb) ((uint8_t)((rgb) >> 8))
+#define GetBValue(rgb) ((uint8_t)((rgb) >> 16))
+#endif
 
 // ==================== BLOCK TYPES ====================
 // Changed to enum class to fix warning
@@ -30,6 +70,7 @@ enum class BlockType {
     BLOCK_SAND,
     BLOCK_GLASS,
     BLOCK_BRICK,
+    BLOCK_LAMP,
     BLOCK_COUNT
 };
 
@@ -44,20 +85,840 @@ COLORREF BlockColors[static_cast<int>(BlockType::BLOCK_COUNT)] = {
     RGB(30, 144, 255),     // Water
     RGB(238, 214, 175),    // Sand
     RGB(220, 220, 220),    // Glass
-    RGB(178, 34, 34)       // Brick
+    RGB(178, 34, 34),      // Brick
+    RGB(255, 214, 110)     // Lamp
 };
 
 const char* BlockNames[static_cast<int>(BlockType::BLOCK_COUNT)] = {
     "Air", "Grass", "Dirt", "Stone", "Wood",
-    "Leaves", "Water", "Sand", "Glass", "Brick"
+    "Leaves", "Water", "Sand", "Glass", "Brick", "Lamp"
+};
+
+// Opacity used when blending; anything below 255 is drawn in the transparent pass
+const int BlockAlpha[static_cast<int>(BlockType::BLOCK_COUNT)] = {
+    0, 255, 255, 255, 255, 255, 160, 255, 96, 255, 255
+};
+
+inline bool IsTransparent(BlockType type) {
+    return BlockAlpha[static_cast<int>(type)] < 255;
+}
+
+// A face is drawn when the neighbour is air, or see-through and of another type
+// (so glass next to brick still shows the brick, but glass next to glass doesn't)
+inline bool IsFaceVisible(BlockType type, BlockType neighbor) {
+    return neighbor == BlockType::BLOCK_AIR || (neighbor != type && IsTransparent(neighbor));
+}
+
+// Light levels run from 0 to LIGHT_MAX. A block's sky and block light share
+// one byte: sky level in the high nibble, block light in the low one.
+const int LIGHT_MAX = 15;
+const uint8_t FULL_SKY_LIGHT = LIGHT_MAX << 4;
+
+enum LightChannel {
+    LIGHT_SKY = 0,
+    LIGHT_BLOCK,
+    LIGHT_CHANNELS
 };
 
+inline int LightLevel(uint8_t packed, int channel) {
+    return channel == LIGHT_SKY ? packed >> 4 : packed & 0x0F;
+}
+
+inline uint8_t WithLightLevel(uint8_t packed, int channel, int level) {
+    return channel == LIGHT_SKY ? static_cast<uint8_t>((packed & 0x0F) | (level << 4))
+                                : static_cast<uint8_t>((packed & 0xF0) | level);
+}
+
+inline int LightEmission(BlockType type) {
+    return type == BlockType::BLOCK_LAMP ? LIGHT_MAX : 0;
+}
+
 // ==================== WORLD SETTINGS ====================
-const int WORLD_WIDTH = 16;
-const int WORLD_DEPTH = 16;
-const int WORLD_HEIGHT = 8;
+const int WORLD_HEIGHT = 32; // Terrain stays below this; the world is unbounded sideways
 const float BLOCK_SIZE = 1.0f;
 
+// ==================== 3D MATH ====================
+struct Vec3 {
+    float x, y, z;
+
+    Vec3(float x = 0, float y = 0, float z = 0) : x(x), y(y), z(z) {}
+
+    Vec3 rotateY(float angle) const {
+        float rad = angle * 3.14159f / 180.0f;
+        float c = cosf(rad);
+        float s = sinf(rad);
+        return Vec3(x * c - z * s, y, x * s + z * c);
+    }
+
+    Vec3 rotateX(float angle) const {
+        float rad = angle * 3.14159f / 180.0f;
+        float c = cosf(rad);
+        float s = sinf(rad);
+        return Vec3(x, y * c - z * s, y * s + z * c);
+    }
+
+    Vec3 operator+(const Vec3& v) const { return Vec3(x + v.x, y + v.y, z + v.z); }
+    Vec3 operator-(const Vec3& v) const { return Vec3(x - v.x, y - v.y, z - v.z); }
+    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
+};
+
+// ==================== FACE STRUCTURE ====================
+// Which side of a block a face lies on
+enum FaceDir {
+    FACE_TOP = 0,   // +Y
+    FACE_BOTTOM,    // -Y
+    FACE_FRONT,     // +Z
+    FACE_BACK,      // -Z
+    FACE_RIGHT,     // +X
+    FACE_LEFT,      // -X
+    FACE_COUNT
+};
+
+const uint8_t ALL_FACES = (1 << FACE_COUNT) - 1;
+
+inline FaceDir OppositeDir(int dir) {
+    return static_cast<FaceDir>(dir ^ 1);
+}
+
+// Normal axis (0 = X, 1 = Y, 2 = Z) and the step to the neighbouring block
+struct FaceDirInfo {
+    int axis;
+    int dx, dy, dz;
+};
+
+// Corner ambient occlusion levels, from the three blocks around a corner
+const uint8_t AO_OPEN = 3;
+
+const FaceDirInfo FaceDirs[FACE_COUNT] = {
+    { 1,  0,  1,  0 },  // Top
+    { 1,  0, -1,  0 },  // Bottom
+    { 2,  0,  0,  1 },  // Front
+    { 2,  0,  0, -1 },  // Back
+    { 0,  1,  0,  0 },  // Right
+    { 0, -1,  0,  0 }   // Left
+};
+
+struct Face {
+    Vec3 corners[4];
+    COLORREF color;
+    bool isTop;
+    FaceDir dir;
+    BlockType type;
+    uint8_t light; // Packed light of the block the face looks out into
+    uint8_t ao[4]; // Ambient occlusion per corner, 0 (enclosed) to AO_OPEN
+
+    // Initialize members to fix warnings
+    Face() : color(0), isTop(false), dir(FACE_TOP), type(BlockType::BLOCK_AIR), light(FULL_SKY_LIGHT) {
+        corners[0] = Vec3();
+        corners[1] = Vec3();
+        corners[2] = Vec3();
+        corners[3] = Vec3();
+        std::fill(ao, ao + 4, AO_OPEN);
+    }
+
+    bool HasOcclusion() const {
+        return (ao[0] & ao[1] & ao[2] & ao[3]) != AO_OPEN;
+    }
+};
+
+// Builds the face on side 'dir' of the box [lo, hi]. Works for a single block
+// as well as for merged greedy-mesh rectangles.
+Face MakeBoxFace(FaceDir dir, const Vec3& lo, const Vec3& hi, BlockType type, uint8_t light) {
+    Face face;
+    switch (dir) {
+    case FACE_TOP:
+        face.corners[0] = Vec3(lo.x, hi.y, lo.z);
+        face.corners[1] = Vec3(hi.x, hi.y, lo.z);
+        face.corners[2] = Vec3(hi.x, hi.y, hi.z);
+        face.corners[3] = Vec3(lo.x, hi.y, hi.z);
+        break;
+    case FACE_BOTTOM:
+        face.corners[0] = Vec3(lo.x, lo.y, lo.z);
+        face.corners[1] = Vec3(lo.x, lo.y, hi.z);
+        face.corners[2] = Vec3(hi.x, lo.y, hi.z);
+        face.corners[3] = Vec3(hi.x, lo.y, lo.z);
+        break;
+    case FACE_FRONT:
+        face.corners[0] = Vec3(lo.x, lo.y, hi.z);
+        face.corners[1] = Vec3(hi.x, lo.y, hi.z);
+        face.corners[2] = Vec3(hi.x, hi.y, hi.z);
+        face.corners[3] = Vec3(lo.x, hi.y, hi.z);
+        break;
+    case FACE_BACK:
+        face.corners[0] = Vec3(lo.x, lo.y, lo.z);
+        face.corners[1] = Vec3(lo.x, hi.y, lo.z);
+        face.corners[2] = Vec3(hi.x, hi.y, lo.z);
+        face.corners[3] = Vec3(hi.x, lo.y, lo.z);
+        break;
+    case FACE_RIGHT:
+        face.corners[0] = Vec3(hi.x, lo.y, lo.z);
+        face.corners[1] = Vec3(hi.x, lo.y, hi.z);
+        face.corners[2] = Vec3(hi.x, hi.y, hi.z);
+        face.corners[3] = Vec3(hi.x, hi.y, lo.z);
+        break;
+    default: // FACE_LEFT
+        face.corners[0] = Vec3(lo.x, lo.y, lo.z);
+        face.corners[1] = Vec3(lo.x, lo.y, hi.z);
+        face.corners[2] = Vec3(lo.x, hi.y, hi.z);
+        face.corners[3] = Vec3(lo.x, hi.y, lo.z);
+        break;
+    }
+    face.color = BlockColors[static_cast<int>(type)];
+    face.isTop = dir == FACE_TOP;
+    face.dir = dir;
+    face.type = type;
+    face.light = light;
+    return face;
+}
+
+// ==================== CHUNK STORAGE ====================
+// The world is unbounded and stored as 16x16x16 chunks keyed by chunk coordinate.
+const int CHUNK_SHIFT = 4;
+const int CHUNK_SIZE = 1 << CHUNK_SHIFT;
+const int CHUNK_MASK = CHUNK_SIZE - 1;
+const int CHUNK_VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+const int MIN_RENDER_DISTANCE = 2;
+const int MAX_RENDER_DISTANCE = 16;
+int renderDistance = 6; // In chunks, around the camera chunk
+
+// Mesh detail levels: level 0 is full detail, level l merges 2^l blocks
+// along each axis into one cell
+const int LOD_COUNT = 4;
+
+// Block corners of a chunk: CHUNK_SIZE + 1 lattice points along each axis
+const int LATTICE_SIZE = CHUNK_SIZE + 1;
+const int LATTICE_VOLUME = LATTICE_SIZE * LATTICE_SIZE * LATTICE_SIZE;
+
+inline int LatticeIndex(int lx, int ly, int lz) {
+    return (ly * LATTICE_SIZE + lz) * LATTICE_SIZE + lx;
+}
+
+struct ChunkCoord {
+    int x, y, z;
+
+    bool operator==(const ChunkCoord& other) const {
+        return x == other.x && y == other.y && z == other.z;
+    }
+    bool operator!=(const ChunkCoord& other) const { return !(*this == other); }
+};
+
+struct ChunkCoordHash {
+    size_t operator()(const ChunkCoord& c) const {
+        // Large primes spread neighbouring chunks across buckets
+        return static_cast<size_t>(c.x) * 73856093u ^
+               static_cast<size_t>(c.y) * 19349663u ^
+               static_cast<size_t>(c.z) * 83492791u;
+    }
+};
+
+// Blocks of one chunk as indices into a small palette, bit-packed into
+// 64-bit words. Index widths are 0, 1, 2, 4 or 8 bits; powers of two keep
+// every index inside a single word, and the width grows as new types show up.
+// A chunk of one type (all air, all stone) uses width 0: a single zero word,
+// so Get needs no special case.
+class PalettedBlocks {
+private:
+    enum { NOT_IN_PALETTE = 0xFF };
+
+    std::vector<uint64_t> words;
+    std::vector<BlockType> palette;
+    uint8_t lookup[static_cast<int>(BlockType::BLOCK_COUNT)]; // Type -> palette slot
+    int bits;
+    uint64_t mask;
+
+    static int BitsFor(size_t paletteSize) {
+        if (paletteSize <= 1) return 0;
+        if (paletteSize <= 2) return 1;
+        if (paletteSize <= 4) return 2;
+        if (paletteSize <= 16) return 4;
+        return 8;
+    }
+
+    int SlotAt(int index) const {
+        uint32_t bit = static_cast<uint32_t>(index) * bits;
+        return static_cast<int>((words[bit >> 6] >> (bit & 63)) & mask);
+    }
+
+    void WriteSlot(std::vector<uint64_t>& target, int width, int index, int slot) {
+        uint32_t bit = static_cast<uint32_t>(index) * width;
+        uint64_t fieldMask = (uint64_t(1) << width) - 1;
+        uint64_t& word = target[bit >> 6];
+        word = (word & ~(fieldMask << (bit & 63))) | (static_cast<uint64_t>(slot) << (bit & 63));
+    }
+
+    // Re-packs every index at a new width, renumbered through remap
+    void Repack(int newBits, const std::vector<int>& remap) {
+        std::vector<uint64_t> packed(std::max(1, CHUNK_VOLUME * newBits / 64), 0);
+        if (newBits > 0) {
+            for (int i = 0; i < CHUNK_VOLUME; i++) WriteSlot(packed, newBits, i, remap[SlotAt(i)]);
+        }
+        words.swap(packed);
+        bits = newBits;
+        mask = (uint64_t(1) << bits) - 1;
+    }
+
+public:
+    PalettedBlocks() { Fill(BlockType::BLOCK_AIR); }
+
+    void Fill(BlockType type) {
+        words.assign(1, 0);
+        palette.assign(1, type);
+        std::fill(lookup, lookup + static_cast<int>(BlockType::BLOCK_COUNT), NOT_IN_PALETTE);
+        lookup[static_cast<int>(type)] = 0;
+        bits = 0;
+        mask = 0;
+    }
+
+    BlockType Get(int index) const {
+        return palette[SlotAt(index)];
+    }
+
+    void Set(int index, BlockType type) {
+        int slot = lookup[static_cast<int>(type)];
+        if (slot == NOT_IN_PALETTE) {
+            slot = static_cast<int>(palette.size());
+            palette.push_back(type);
+            lookup[static_cast<int>(type)] = static_cast<uint8_t>(slot);
+
+            int needed = BitsFor(palette.size());
+            if (needed != bits) {
+                std::vector<int> identity(palette.size());
+                for (size_t i = 0; i < identity.size(); i++) identity[i] = static_cast<int>(i);
+                Repack(needed, identity);
+            }
+        }
+        if (bits > 0) WriteSlot(words, bits, index, slot);
+    }
+
+    // Drops palette entries no block uses any more and narrows the indices,
+    // e.g. once a chunk has been generated or loaded
+    void Compact() {
+        std::vector<int> used(palette.size(), 0);
+        for (int i = 0; i < CHUNK_VOLUME; i++) used[SlotAt(i)] = 1;
+
+        std::vector<int> remap(palette.size(), 0);
+        std::vector<BlockType> kept;
+        for (size_t slot = 0; slot < palette.size(); slot++) {
+            if (!used[slot]) continue;
+            remap[slot] = static_cast<int>(kept.size());
+            kept.push_back(palette[slot]);
+        }
+        if (kept.size() == palette.size()) return;
+
+        Repack(BitsFor(kept.size()), remap);
+        palette.swap(kept);
+        std::fill(lookup, lookup + static_cast<int>(BlockType::BLOCK_COUNT), NOT_IN_PALETTE);
+        for (size_t slot = 0; slot < palette.size(); slot++) {
+            lookup[static_cast<int>(palette[slot])] = static_cast<uint8_t>(slot);
+        }
+    }
+
+    int BitsPerBlock() const { return bits; }
+
+    size_t MemoryBytes() const {
+        return sizeof(*this) + words.capacity() * sizeof(uint64_t) + palette.capacity() * sizeof(BlockType);
+    }
+};
+
+// Faces of one detail level, grouped by direction: faces of FaceDir d are
+// faces[dirStart[d], dirStart[d + 1]).
+struct ChunkMesh {
+    std::vector<Face> faces;
+    int dirStart[FACE_COUNT + 1];
+
+    // Lattice corner ids of each face (4 per face), so corners shared by
+    // neighbouring faces are projected once per frame
+    std::vector<uint16_t> cornerIds;
+    bool built; // Cleared whenever the chunk's blocks change
+
+    ChunkMesh() : built(false) {
+        std::fill(dirStart, dirStart + FACE_COUNT + 1, 0);
+    }
+};
+
+struct Chunk {
+    ChunkCoord coord;
+    PalettedBlocks blocks;
+    int solidCount; // Non-air blocks, lets empty chunks be skipped
+
+    // Cached faces per detail level, each built the first time it is drawn.
+    // meshDirty is set when this chunk or a bordering block changes.
+    ChunkMesh meshes[LOD_COUNT];
+    int lod; // Level picked last frame, kept until the distance clearly changes
+    bool meshDirty;
+    bool unsavedEdits; // Changed by the player or flowing water since it was generated or loaded
+
+    // Bit j of faceLinks[i] is set when see-through blocks connect chunk faces
+    // i and j (FaceDir order). Starts fully open; linksDirty is set whenever a
+    // block changes and cleared when the links are worked out again.
+    uint8_t faceLinks[FACE_COUNT];
+    bool linksDirty;
+
+    // Packed sky and block light per block, same order as the blocks. While
+    // every block has the same light (open sky, solid rock) the array is left
+    // empty and lightFill holds that value. Starts as open sky until the
+    // light engine has run over the chunk.
+    std::vector<uint8_t> light;
+    uint8_t lightFill;
+
+    // Flowing water levels as (block index, level), only while the chunk is
+    // on its way to or from a region file. The water simulation owns them
+    // the rest of the time.
+    std::vector<std::pair<uint16_t, uint8_t>> flowLevels;
+
+    explicit Chunk(const ChunkCoord& c)
+        : coord(c), solidCount(0), lod(0), meshDirty(true), unsavedEdits(false), linksDirty(true),
+          lightFill(FULL_SKY_LIGHT) {
+        std::fill(faceLinks, faceLinks + FACE_COUNT, ALL_FACES);
+    }
+
+    uint8_t LightAt(int index) const {
+        return light.empty() ? lightFill : light[index];
+    }
+
+    // Expands the array on the first write that differs from lightFill
+    void SetLight(int index, uint8_t value) {
+        if (light.empty()) {
+            if (value == lightFill) return;
+            light.assign(CHUNK_VOLUME, lightFill);
+        }
+        light[index] = value;
+    }
+
+    // Goes back to a single value if the light ended up uniform
+    void CompactLight() {
+        if (light.empty()) return;
+        for (int i = 1; i < CHUNK_VOLUME; i++) {
+            if (light[i] != light[0]) return;
+        }
+        lightFill = light[0];
+        std::vector<uint8_t>().swap(light);
+    }
+
+    size_t LightBytes() const { return light.capacity(); }
+
+    // Whether the mesh of the current level can be drawn as it is
+    bool MeshReady() const {
+        return !meshDirty && meshes[lod].built;
+    }
+
+    // X varies fastest so a row of blocks is contiguous
+    static int Index(int lx, int ly, int lz) {
+        return (ly << (2 * CHUNK_SHIFT)) | (lz << CHUNK_SHIFT) | lx;
+    }
+
+    BlockType Get(int lx, int ly, int lz) const {
+        return blocks.Get(Index(lx, ly, lz));
+    }
+
+    void Set(int lx, int ly, int lz, BlockType type) {
+        int index = Index(lx, ly, lz);
+        solidCount += (type != BlockType::BLOCK_AIR) - (blocks.Get(index) != BlockType::BLOCK_AIR);
+        blocks.Set(index, type);
+        linksDirty = true;
+    }
+};
+
+class ChunkStore {
+private:
+    std::unordered_map<ChunkCoord, std::unique_ptr<Chunk>, ChunkCoordHash> chunks;
+
+public:
+    // Arithmetic shift floors negative coordinates, so -1 lands in chunk -1
+    static ChunkCoord ToChunkCoord(int x, int y, int z) {
+        return { x >> CHUNK_SHIFT, y >> CHUNK_SHIFT, z >> CHUNK_SHIFT };
+    }
+
+    Chunk* GetChunk(const ChunkCoord& coord) const {
+        auto it = chunks.find(coord);
+        return it != chunks.end() ? it->second.get() : nullptr;
+    }
+
+    Chunk* GetOrCreateChunk(const ChunkCoord& coord) {
+        std::unique_ptr<Chunk>& slot = chunks[coord];
+        if (!slot) slot.reset(new Chunk(coord));
+        return slot.get();
+    }
+
+    BlockType GetBlock(int x, int y, int z) const {
+        const Chunk* chunk = GetChunk(ToChunkCoord(x, y, z));
+        if (!chunk) return BlockType::BLOCK_AIR;
+        return chunk->Get(x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK);
+    }
+
+    void SetBlock(int x, int y, int z, BlockType type) {
+        ChunkCoord coord = ToChunkCoord(x, y, z);
+        Chunk* chunk = GetChunk(coord);
+        if (!chunk) {
+            if (type == BlockType::BLOCK_AIR) return; // Missing chunks are already air
+            chunk = GetOrCreateChunk(coord);
+        }
+        int lx = x & CHUNK_MASK, ly = y & CHUNK_MASK, lz = z & CHUNK_MASK;
+        if (chunk->Get(lx, ly, lz) == type) return;
+
+        chunk->Set(lx, ly, lz, type);
+        chunk->unsavedEdits = true;
+        MarkMeshDirty(coord, lx, ly, lz);
+    }
+
+    // Flags the chunk holding a block plus every chunk that touches that block,
+    // since their meshes read it across the border
+    void MarkMeshDirty(const ChunkCoord& coord, int lx, int ly, int lz) {
+        int loX = lx == 0 ? -1 : 0, hiX = lx == CHUNK_MASK ? 1 : 0;
+        int loY = ly == 0 ? -1 : 0, hiY = ly == CHUNK_MASK ? 1 : 0;
+        int loZ = lz == 0 ? -1 : 0, hiZ = lz == CHUNK_MASK ? 1 : 0;
+
+        for (int dx = loX; dx <= hiX; dx++) {
+            for (int dy = loY; dy <= hiY; dy++) {
+                for (int dz = loZ; dz <= hiZ; dz++) {
+                    Chunk* chunk = GetChunk({ coord.x + dx, coord.y + dy, coord.z + dz });
+                    if (chunk) chunk->meshDirty = true;
+                }
+            }
+        }
+    }
+
+    // Adds a chunk built elsewhere, such as on a streaming thread. A chunk
+    // already at that coordinate is kept, since it may hold edits. Returns
+    // whichever chunk now sits at the coordinate.
+    Chunk* Insert(std::unique_ptr<Chunk> chunk) {
+        ChunkCoord coord = chunk->coord;
+        std::unique_ptr<Chunk>& slot = chunks[coord];
+        if (slot) return slot.get();
+        slot = std::move(chunk);
+        MarkNeighborsDirty(coord);
+        return slot.get();
+    }
+
+    // Drops every chunk matching pred; returns how many went
+    template <typename Pred>
+    int RemoveIf(Pred pred) {
+        std::vector<ChunkCoord> removed;
+        for (auto it = chunks.begin(); it != chunks.end();) {
+            if (pred(*it->second)) {
+                removed.push_back(it->first);
+                it = chunks.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        for (const ChunkCoord& coord : removed) MarkNeighborsDirty(coord);
+        return static_cast<int>(removed.size());
+    }
+
+    // The 26 chunks around coord mesh against it, so they need rebuilding
+    // when it appears or disappears
+    void MarkNeighborsDirty(const ChunkCoord& coord) {
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dz = -1; dz <= 1; dz++) {
+                    Chunk* chunk = GetChunk({ coord.x + dx, coord.y + dy, coord.z + dz });
+                    if (chunk) chunk->meshDirty = true;
+                }
+            }
+        }
+    }
+
+    void Clear() { chunks.clear(); }
+
+    template <typename Fn>
+    void ForEachChunk(Fn fn) {
+        for (auto& entry : chunks) fn(*entry.second);
+    }
+
+    // Forces every mesh to be rebuilt, e.g. after switching mesh mode
+    void MarkAllMeshesDirty() {
+        for (auto& entry : chunks) entry.second->meshDirty = true;
+    }
+
+    size_t ChunkCount() const { return chunks.size(); }
+};
+
+// First solid block found along a ray
+struct RayHit {
+    int x, y, z;     // Block that was hit
+    int nx, ny, nz;  // Normal of the face the ray entered through
+    float distance;  // Along the ray, in units of its direction vector
+    BlockType type;  // BLOCK_AIR when nothing was hit
+};
+
+// ==================== SPARSE VOXEL DAG ====================
+// Read-only octree snapshot of the chunk store in which identical subtrees
+// are stored once, turning the tree into a DAG. Uniform regions of any size
+// collapse into a single reference, so large flat or empty areas and
+// repeated structures cost almost nothing. Meant for big read-mostly worlds
+// (map views, ray queries); editing still goes through the chunk store.
+class VoxelDAG {
+    // A reference is either a uniform block type (LEAF_BIT set) or a node index
+    static const uint32_t LEAF_BIT = 0x80000000u;
+
+    struct Node {
+        uint32_t children[8]; // Child i covers the octant with x = bit 0, y = bit 1, z = bit 2
+        bool operator==(const Node& other) const {
+            return memcmp(children, other.children, sizeof(children)) == 0;
+        }
+    };
+
+    struct NodeHash {
+        size_t operator()(const Node& node) const {
+            uint64_t h = 1469598103934665603ull;
+            for (uint32_t child : node.children) h = (h ^ child) * 1099511628211ull;
+            return static_cast<size_t>(h);
+        }
+    };
+
+    std::vector<Node> nodes;
+    std::unordered_map<Node, uint32_t, NodeHash> unique; // Only used while building
+    uint32_t root;
+    int originX, originY, originZ;
+    int size; // Edge length of the root cube in blocks, a power of two
+    bool built;
+
+    static uint32_t Leaf(BlockType type) { return LEAF_BIT | static_cast<uint32_t>(type); }
+    static bool IsLeaf(uint32_t ref) { return (ref & LEAF_BIT) != 0; }
+    static BlockType LeafType(uint32_t ref) { return static_cast<BlockType>(ref & ~LEAF_BIT); }
+
+    // Collapses eight equal leaves, otherwise shares an existing identical node
+    uint32_t Intern(const Node& node) {
+        bool uniform = IsLeaf(node.children[0]);
+        for (int i = 1; i < 8 && uniform; i++) uniform = node.children[i] == node.children[0];
+        if (uniform) return node.children[0];
+
+        auto it = unique.find(node);
+        if (it != unique.end()) return it->second;
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(node);
+        unique.emplace(node, index);
+        return index;
+    }
+
+    uint32_t BuildInChunk(const Chunk& chunk, int lx, int ly, int lz, int edge) {
+        if (edge == 1) return Leaf(chunk.Get(lx, ly, lz));
+        int half = edge / 2;
+        Node node;
+        for (int i = 0; i < 8; i++) {
+            node.children[i] = BuildInChunk(chunk, lx + (i & 1) * half, ly + ((i >> 1) & 1) * half,
+                                            lz + ((i >> 2) & 1) * half, half);
+        }
+        return Intern(node);
+    }
+
+    uint32_t Build(const ChunkStore& store, int x, int y, int z, int edge) {
+        if (edge == CHUNK_SIZE) {
+            const Chunk* chunk = store.GetChunk(ChunkStore::ToChunkCoord(x, y, z));
+            if (!chunk || chunk->solidCount == 0) return Leaf(BlockType::BLOCK_AIR);
+            if (chunk->blocks.BitsPerBlock() == 0) return Leaf(chunk->blocks.Get(0));
+            return BuildInChunk(*chunk, 0, 0, 0, CHUNK_SIZE);
+        }
+        int half = edge / 2;
+        Node node;
+        for (int i = 0; i < 8; i++) {
+            node.children[i] = Build(store, x + (i & 1) * half, y + ((i >> 1) & 1) * half,
+                                     z + ((i >> 2) & 1) * half, half);
+        }
+        return Intern(node);
+    }
+
+    // Finds the uniform region holding a block; returns its type and box
+    BlockType Descend(int x, int y, int z, int& boxX, int& boxY, int& boxZ, int& boxSize) const {
+        uint32_t ref = root;
+        boxX = originX; boxY = originY; boxZ = originZ; boxSize = size;
+        while (!IsLeaf(ref)) {
+            boxSize /= 2;
+            int i = 0;
+            if (x >= boxX + boxSize) { i |= 1; boxX += boxSize; }
+            if (y >= boxY + boxSize) { i |= 2; boxY += boxSize; }
+            if (z >= boxZ + boxSize) { i |= 4; boxZ += boxSize; }
+            ref = nodes[ref].children[i];
+        }
+        return LeafType(ref);
+    }
+
+    // Writes a subtree into one chunk; returns whether any block changed
+    bool FillInChunk(Chunk& chunk, uint32_t ref, int lx, int ly, int lz, int edge) const {
+        bool changed = false;
+        if (IsLeaf(ref)) {
+            BlockType type = LeafType(ref);
+            for (int y = ly; y < ly + edge; y++) {
+                for (int z = lz; z < lz + edge; z++) {
+                    for (int x = lx; x < lx + edge; x++) {
+                        if (chunk.Get(x, y, z) == type) continue;
+                        chunk.Set(x, y, z, type);
+                        changed = true;
+                    }
+                }
+            }
+            return changed;
+        }
+        int half = edge / 2;
+        for (int i = 0; i < 8; i++) {
+            changed |= FillInChunk(chunk, nodes[ref].children[i], lx + (i & 1) * half, ly + ((i >> 1) & 1) * half,
+                                   lz + ((i >> 2) & 1) * half, half);
+        }
+        return changed;
+    }
+
+    void Fill(ChunkStore& store, uint32_t ref, int x, int y, int z, int edge, std::vector<ChunkCoord>& changed) const {
+        if (edge > CHUNK_SIZE) {
+            int half = edge / 2;
+            for (int i = 0; i < 8; i++) {
+                uint32_t child = IsLeaf(ref) ? ref : nodes[ref].children[i];
+                Fill(store, child, x + (i & 1) * half, y + ((i >> 1) & 1) * half, z + ((i >> 2) & 1) * half, half,
+                     changed);
+            }
+            return;
+        }
+
+        ChunkCoord coord = ChunkStore::ToChunkCoord(x, y, z);
+        Chunk* chunk = store.GetChunk(coord);
+        if (!chunk) {
+            if (IsLeaf(ref) && LeafType(ref) == BlockType::BLOCK_AIR) return; // Missing chunks read as air
+            if (!store.GetChunk({ coord.x, 0, coord.z })) return;             // Column not loaded
+            chunk = store.GetOrCreateChunk(coord);
+        }
+
+        if (IsLeaf(ref)) {
+            // A whole chunk of one type
+            BlockType type = LeafType(ref);
+            if (chunk->blocks.BitsPerBlock() == 0 && chunk->blocks.Get(0) == type) return;
+            chunk->blocks.Fill(type);
+            chunk->solidCount = type == BlockType::BLOCK_AIR ? 0 : CHUNK_VOLUME;
+            chunk->linksDirty = true;
+        }
+        else {
+            if (!FillInChunk(*chunk, ref, 0, 0, 0, CHUNK_SIZE)) return;
+            chunk->blocks.Compact();
+        }
+        chunk->unsavedEdits = true;
+        store.MarkNeighborsDirty(coord);
+        changed.push_back(coord);
+    }
+
+public:
+    VoxelDAG() : root(Leaf(BlockType::BLOCK_AIR)), originX(0), originY(0), originZ(0), size(CHUNK_SIZE), built(false) {}
+
+    // Snapshots every chunk of the store into a cube aligned to the chunk grid
+    void BuildFromStore(ChunkStore& store) {
+        nodes.clear();
+        unique.clear();
+
+        bool any = false;
+        ChunkCoord lo = { 0, 0, 0 }, hi = { 0, 0, 0 };
+        store.ForEachChunk([&](Chunk& chunk) {
+            const ChunkCoord& c = chunk.coord;
+            if (!any) { lo = hi = c; any = true; }
+            lo = { std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z) };
+            hi = { std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z) };
+        });
+
+        int extent = std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z)) + 1;
+        int chunksPerSide = 1;
+        while (chunksPerSide < extent) chunksPerSide *= 2;
+        size = chunksPerSide * CHUNK_SIZE;
+        originX = lo.x * CHUNK_SIZE;
+        originY = lo.y * CHUNK_SIZE;
+        originZ = lo.z * CHUNK_SIZE;
+
+        root = Build(store, originX, originY, originZ, size);
+        built = true;
+
+        // The dedup table is only needed while building
+        std::unordered_map<Node, uint32_t, NodeHash>().swap(unique);
+        nodes.shrink_to_fit();
+    }
+
+    BlockType GetBlock(int x, int y, int z) const {
+        if (x < originX || y < originY || z < originZ ||
+            x >= originX + size || y >= originY + size || z >= originZ + size) {
+            return BlockType::BLOCK_AIR;
+        }
+        int boxX, boxY, boxZ, boxSize;
+        return Descend(x, y, z, boxX, boxY, boxZ, boxSize);
+    }
+
+    // First non-air block along origin + t * dir for t in [0, maxDistance].
+    // Empty regions are crossed in one step whatever their size.
+    bool Raycast(const Vec3& origin, const Vec3& dir, float maxDistance, RayHit& hit) const {
+        const float o[3] = { origin.x, origin.y, origin.z };
+        const float d[3] = { dir.x, dir.y, dir.z };
+        const int boxMin[3] = { originX, originY, originZ };
+
+        // Clip the ray to the root cube
+        float tEnter = 0.0f, tExit = maxDistance;
+        int enterAxis = -1;
+        for (int a = 0; a < 3; a++) {
+            float lo = static_cast<float>(boxMin[a]), hi = static_cast<float>(boxMin[a] + size);
+            if (d[a] == 0.0f) {
+                if (o[a] < lo || o[a] >= hi) return false;
+                continue;
+            }
+            float t0 = (lo - o[a]) / d[a], t1 = (hi - o[a]) / d[a];
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > tEnter) { tEnter = t0; enterAxis = a; }
+            tExit = std::min(tExit, t1);
+        }
+        if (tEnter > tExit) return false;
+
+        int cell[3], normal[3] = { 0, 0, 0 };
+        for (int a = 0; a < 3; a++) {
+            int c = static_cast<int>(floorf(o[a] + d[a] * tEnter));
+            cell[a] = std::max(boxMin[a], std::min(boxMin[a] + size - 1, c));
+        }
+        if (enterAxis >= 0) {
+            cell[enterAxis] = d[enterAxis] > 0.0f ? boxMin[enterAxis] : boxMin[enterAxis] + size - 1;
+            normal[enterAxis] = d[enterAxis] > 0.0f ? -1 : 1;
+        }
+
+        float t = tEnter;
+        for (;;) {
+            int box[3], boxSize;
+            BlockType type = Descend(cell[0], cell[1], cell[2], box[0], box[1], box[2], boxSize);
+            if (type != BlockType::BLOCK_AIR) {
+                hit = { cell[0], cell[1], cell[2], normal[0], normal[1], normal[2], t, type };
+                return true;
+            }
+
+            // Leave the whole empty box through its nearest exit face
+            int axis = -1;
+            float tNext = 0.0f;
+            for (int a = 0; a < 3; a++) {
+                if (d[a] == 0.0f) continue;
+                float bound = static_cast<float>(d[a] > 0.0f ? box[a] + boxSize : box[a]);
+                float ta = (bound - o[a]) / d[a];
+                if (axis < 0 || ta < tNext) { axis = a; tNext = ta; }
+            }
+            if (axis < 0 || tNext > tExit) return false;
+            t = tNext;
+
+            for (int a = 0; a < 3; a++) {
+                if (a == axis) continue;
+                int c = static_cast<int>(floorf(o[a] + d[a] * t));
+                cell[a] = std::max(box[a], std::min(box[a] + boxSize - 1, c));
+                normal[a] = 0;
+            }
+            cell[axis] = d[axis] > 0.0f ? box[axis] + boxSize : box[axis] - 1;
+            normal[axis] = d[axis] > 0.0f ? -1 : 1;
+            if (cell[axis] < boxMin[axis] || cell[axis] >= boxMin[axis] + size) return false;
+        }
+    }
+
+    // Writes the snapshot back into the store, air included, so every loaded
+    // chunk inside the snapshot cube matches it again. Uniform chunks are
+    // filled in one go. Changed chunks are marked for meshing and saving and
+    // listed in 'changed'; their light is left to the caller.
+    void ToChunks(ChunkStore& store, std::vector<ChunkCoord>& changed) const {
+        if (built) Fill(store, root, originX, originY, originZ, size, changed);
+    }
+
+    int NodeCount() const { return static_cast<int>(nodes.size()); }
+
+    size_t MemoryBytes() const { return sizeof(*this) + nodes.capacity() * sizeof(Node); }
+};
+
+VoxelDAG worldSnapshot;     // Rebuilt on demand (O key)
+double snapshotBuildMs = 0.0; // Shown on the DAG line of the HUD
+
 // ==================== CAMERA ====================
 struct Camera {
     float x, y, z;      // Position
@@ -82,7 +943,7 @@ struct Camera {
 };
 
 // ==================== WORLD DATA ====================
-BlockType world[WORLD_WIDTH][WORLD_HEIGHT][WORLD_DEPTH];
+ChunkStore world;
 Camera camera;
 bool wireframeMode = false;
 bool fogEnabled = true;
@@ -90,34 +951,51 @@ int selectedBlock = static_cast<int>(BlockType::BLOCK_GRASS);
 bool showGrid = true;
 bool dayNightCycle = true;
 float timeOfDay = 12.0f; // 0-24 hours
+bool greedyMeshing = false; // Merge coplanar faces into larger quads
+bool occlusionCulling = true; // Skip chunks no see-through path leads to
+bool lodEnabled = true; // Coarser meshes for distant chunks
+uint32_t worldSeed = 1337;  // Same seed, same terrain
+uint32_t worldRevision = 0; // Bumped whenever blocks or light change
 
+#ifdef _WIN32
 // ==================== MOUSE LOOK ====================
 bool mouseLookEnabled = false;
 POINT mouseCenter;
 int mouseSensitivity = 2;
+#endif
 
 // ==================== FPS COUNTER ====================
+// High resolution clock in milliseconds
+double GetTimeMs() {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency = {};
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return static_cast<double>(now.QuadPart) * 1000.0 / static_cast<double>(frequency.QuadPart);
+#else
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
 class FPSCounter {
 private:
     int frameCount;
     float timePassed;
     float fps;
-    LARGE_INTEGER frequency;
-    LARGE_INTEGER lastTime;
+    double lastTime;
 
 public:
-    FPSCounter() : frameCount(0), timePassed(0.0f), fps(0.0f) {
-        QueryPerformanceFrequency(&frequency);
-        QueryPerformanceCounter(&lastTime);
-    }
+    FPSCounter() : frameCount(0), timePassed(0.0f), fps(0.0f), lastTime(GetTimeMs()) {}
 
     void Update() {
         frameCount++;
 
-        LARGE_INTEGER currentTime;
-        QueryPerformanceCounter(&currentTime);
+        double currentTime = GetTimeMs();
 
-        float deltaTime = static_cast<float>(currentTime.QuadPart - lastTime.QuadPart) / static_cast<float>(frequency.QuadPart);
+        float deltaTime = static_cast<float>((currentTime - lastTime) / 1000.0);
         timePassed += deltaTime;
 
         if (timePassed >= 0.5f) { // Update FPS every 0.5 seconds
@@ -134,378 +1012,3216 @@ public:
 
 FPSCounter fpsCounter;
 
-// ==================== DOUBLE BUFFERING ====================
-HDC hBufferDC = NULL;
-HBITMAP hBufferBitmap = NULL;
-int bufferWidth = 800;
-int bufferHeight = 600;
-HWND g_hwnd = NULL;
+// Stats from the last rendered frame, shown in the HUD to compare mesh modes
+struct FrameStats {
+    int quads;
+    int projectedCorners; // Unique lattice corners projected this frame
+    float renderMs;
+    int visibleChunks;
+    int culledChunks;
+    int occludedChunks; // In the frustum but sealed off from the camera
+    int foggedChunks;   // Entirely past the fog distance
+    int foggedFaces;
+    int culledFaces;
+    int backfacesRejected;
+    int lodChunks[LOD_COUNT]; // Chunks drawn at each detail level
+
+    // Where renderMs went. Collect covers chunk visits, culling and face
+    // gathering; project includes building the screen triangles.
+    float streamMs, meshMs, collectMs, sortMs, projectMs, rasterMs;
+
+    // Since startup; a skipped frame was a paint that showed the previous image again
+    int renderedFrames, skippedFrames;
+};
 
-// ==================== 3D MATH ====================
-struct Vec3 {
-    float x, y, z;
+FrameStats frameStats = {};
 
-    Vec3(float x = 0, float y = 0, float z = 0) : x(x), y(y), z(z) {}
+// ==================== JOB SYSTEM ====================
+// Work-stealing thread pool. Every worker owns a deque: it pops its own tasks
+// from the back and, when empty, steals from the front of the others. The
+// thread calling ParallelFor joins in as worker 0, so a pool with no threads
+// simply runs everything inline.
+class JobSystem {
+private:
+    struct Task {
+        const std::function<void(int, int)>* body;
+        int begin, end;
+        std::atomic<int>* remaining;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<int> queuedTasks;
+    bool quit;
+
+    bool PopTask(int worker, Task& task) {
+        // Own queue first (newest task, still warm in cache)
+        {
+            WorkerQueue& own = *queues[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        // Then steal the oldest task from someone else
+        int count = static_cast<int>(queues.size());
+        for (int i = 1; i < count; i++) {
+            WorkerQueue& victim = *queues[(worker + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool RunOne(int worker) {
+        Task task;
+        if (!PopTask(worker, task)) return false;
+        queuedTasks--;
+
+        for (int i = task.begin; i < task.end; i++) {
+            (*task.body)(i, worker);
+        }
+        task.remaining->fetch_sub(1);
+        return true;
+    }
+
+    void WorkerLoop(int worker) {
+        for (;;) {
+            if (RunOne(worker)) continue;
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return quit || queuedTasks.load() > 0; });
+            if (quit) return;
+        }
+    }
+
+public:
+    JobSystem() : queuedTasks(0), quit(false) {
+        queues.emplace_back(new WorkerQueue());
+    }
+
+    ~JobSystem() { Stop(); }
+
+    // Spawns threadCount background workers (0 = one per extra hardware core)
+    void Start(int threadCount = 0) {
+        Stop();
+        if (threadCount <= 0) {
+            threadCount = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+        }
+        quit = false;
+        for (int i = 0; i < threadCount; i++) {
+            queues.emplace_back(new WorkerQueue());
+        }
+        for (int i = 1; i <= threadCount; i++) {
+            threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+        }
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) thread.join();
+        threads.clear();
+        queues.resize(1);
+    }
+
+    // Threads that can run tasks, including the caller
+    int WorkerCount() const { return static_cast<int>(queues.size()); }
+
+    // Runs body(index, worker) for every index in [0, count) and returns when
+    // all are done. 'worker' is in [0, WorkerCount()) and is never shared by two
+    // tasks running at once, so it can select per-worker scratch buffers.
+    void ParallelFor(int count, int grain, const std::function<void(int, int)>& body) {
+        if (count <= 0) return;
+        if (grain < 1) grain = 1;
+
+        int taskCount = (count + grain - 1) / grain;
+        std::atomic<int> remaining(taskCount);
+
+        // Deal tasks round-robin; stealing evens out whatever imbalance is left
+        int workers = WorkerCount();
+        for (int t = 0; t < taskCount; t++) {
+            Task task = { &body, t * grain, std::min(count, (t + 1) * grain), &remaining };
+            WorkerQueue& queue = *queues[t % workers];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(task);
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queuedTasks += taskCount;
+        }
+        wake.notify_all();
+
+        while (remaining.load() > 0) {
+            if (!RunOne(0)) std::this_thread::yield();
+        }
+    }
+};
+
+JobSystem jobSystem;
+
+// ==================== VOXEL RAYCASTING ====================
+// Amanatides-Woo grid traversal over the chunk store: the ray steps from
+// block to block in the order it crosses them, so no solid block is skipped.
+// Missing and empty chunks are crossed in a single step.
+const float PICK_DISTANCE = 8.0f; // Reach for placing and breaking blocks
+
+struct Ray {
+    Vec3 origin;
+    Vec3 dir;
+    float maxDistance; // In units of dir
+};
+
+bool RaycastBlocks(const ChunkStore& store, const Ray& ray, RayHit& hit) {
+    const float o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+    const float d[3] = { ray.dir.x, ray.dir.y, ray.dir.z };
+
+    int cell[3], step[3], normal[3] = { 0, 0, 0 };
+    float tMax[3], tDelta[3];
+    for (int a = 0; a < 3; a++) {
+        cell[a] = static_cast<int>(floorf(o[a]));
+        step[a] = d[a] > 0.0f ? 1 : -1;
+        tDelta[a] = d[a] != 0.0f ? fabsf(1.0f / d[a]) : FLT_MAX;
+        tMax[a] = d[a] != 0.0f ? (cell[a] + (d[a] > 0.0f) - o[a]) / d[a] : FLT_MAX;
+    }
+
+    hit = { 0, 0, 0, 0, 0, 0, ray.maxDistance, BlockType::BLOCK_AIR };
+    float t = 0.0f;
+    ChunkCoord chunkCoord = ChunkStore::ToChunkCoord(cell[0], cell[1], cell[2]);
+    const Chunk* chunk = store.GetChunk(chunkCoord);
+    for (;;) {
+        if (!chunk || chunk->solidCount == 0) {
+            // Leave the whole chunk through its nearest exit face
+            const int chunkMin[3] = { chunkCoord.x * CHUNK_SIZE, chunkCoord.y * CHUNK_SIZE,
+                                      chunkCoord.z * CHUNK_SIZE };
+            int axis = -1;
+            float tNext = 0.0f;
+            for (int a = 0; a < 3; a++) {
+                if (d[a] == 0.0f) continue;
+                float bound = static_cast<float>(d[a] > 0.0f ? chunkMin[a] + CHUNK_SIZE : chunkMin[a]);
+                float ta = (bound - o[a]) / d[a];
+                if (axis < 0 || ta < tNext) { axis = a; tNext = ta; }
+            }
+            if (axis < 0 || tNext > ray.maxDistance) return false;
+            t = std::max(t, tNext);
+
+            for (int a = 0; a < 3; a++) {
+                if (a == axis) continue;
+                int c = static_cast<int>(floorf(o[a] + d[a] * t));
+                cell[a] = std::max(chunkMin[a], std::min(chunkMin[a] + CHUNK_SIZE - 1, c));
+                normal[a] = 0;
+                if (d[a] != 0.0f) tMax[a] = (cell[a] + (d[a] > 0.0f) - o[a]) / d[a];
+            }
+            cell[axis] = d[axis] > 0.0f ? chunkMin[axis] + CHUNK_SIZE : chunkMin[axis] - 1;
+            normal[axis] = -step[axis];
+            tMax[axis] = t + tDelta[axis];
+        }
+        else {
+            BlockType type = chunk->Get(cell[0] & CHUNK_MASK, cell[1] & CHUNK_MASK, cell[2] & CHUNK_MASK);
+            if (type != BlockType::BLOCK_AIR) {
+                hit = { cell[0], cell[1], cell[2], normal[0], normal[1], normal[2], t, type };
+                return true;
+            }
+
+            // Step into whichever neighbour the ray reaches first
+            int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+            t = tMax[axis];
+            if (t > ray.maxDistance) return false;
+            cell[axis] += step[axis];
+            tMax[axis] += tDelta[axis];
+            normal[0] = normal[1] = normal[2] = 0;
+            normal[axis] = -step[axis];
+        }
+
+        ChunkCoord next = ChunkStore::ToChunkCoord(cell[0], cell[1], cell[2]);
+        if (!(next == chunkCoord)) {
+            chunkCoord = next;
+            chunk = store.GetChunk(chunkCoord);
+        }
+    }
+}
+
+// Casts many rays at once (picking, line of sight, light probes) spread over
+// the job system. Misses come back with type BLOCK_AIR. Returns the hit count.
+int RaycastBatch(const ChunkStore& store, const std::vector<Ray>& rays, std::vector<RayHit>& hits) {
+    hits.resize(rays.size());
+    std::atomic<int> hitCount(0);
+    const int RAYS_PER_TASK = 256;
+    int tasks = static_cast<int>((rays.size() + RAYS_PER_TASK - 1) / RAYS_PER_TASK);
+    jobSystem.ParallelFor(tasks, 1, [&](int task, int) {
+        size_t begin = static_cast<size_t>(task) * RAYS_PER_TASK;
+        size_t end = std::min(rays.size(), begin + RAYS_PER_TASK);
+        int found = 0;
+        for (size_t i = begin; i < end; i++) found += RaycastBlocks(store, rays[i], hits[i]);
+        hitCount += found;
+    });
+    return hitCount.load();
+}
+
+// Ray from the camera through the centre of the screen
+Ray ViewRay(float maxDistance) {
+    float yawRad = camera.yaw * 3.14159f / 180.0f;
+    float pitchRad = camera.pitch * 3.14159f / 180.0f;
+    Vec3 dir(sinf(yawRad) * cosf(pitchRad), sinf(pitchRad), cosf(yawRad) * cosf(pitchRad));
+    return { Vec3(camera.x, camera.y, camera.z), dir, maxDistance };
+}
+
+// ==================== DOUBLE BUFFERING ====================
+int bufferWidth = 800;
+int bufferHeight = 600;
+#ifdef _WIN32
+HDC hBufferDC = NULL;
+HBITMAP hBufferBitmap = NULL;
+HWND g_hwnd = NULL;
+#endif
+
+// ==================== TERRAIN GENERATION ====================
+// Heights come from seeded 2D gradient noise summed over a few octaves. The
+// noise kernel runs 4 columns at a time with SSE2 and has a scalar twin with
+// the same operations in the same order, so both produce identical heights.
+// Every block depends only on the seed and its own position, which makes the
+// terrain the same however many threads generate it.
+const int TERRAIN_OCTAVES = 4;
+const float TERRAIN_FREQUENCY = 1.0f / 64.0f;
+const int TERRAIN_BASE = 6;
+const float TERRAIN_AMPLITUDE = 9.0f;
+const int SEA_LEVEL = 4;
+const int TREE_CHANCE = 90; // One tree per this many grass columns, on average
+
+struct TerrainStats {
+    int chunks;
+    double ms;
+} terrainStats = {};
+
+inline uint32_t HashLattice(int32_t x, int32_t z, uint32_t seed) {
+    uint32_t h = (static_cast<uint32_t>(x) * 0x27d4eb2du) ^ (static_cast<uint32_t>(z) * 0x165667b1u) ^ seed;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+// Dot product with one of four diagonal gradients picked by the hash
+inline float Gradient(uint32_t h, float dx, float dz) {
+    return ((h & 1) ? -dx : dx) + ((h & 2) ? -dz : dz);
+}
+
+inline float Fade(float t) {
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+float GradientNoise(float x, float z, uint32_t seed) {
+    float fx = floorf(x), fz = floorf(z);
+    int32_t ix = static_cast<int32_t>(fx), iz = static_cast<int32_t>(fz);
+    float dx = x - fx, dz = z - fz;
+
+    float n00 = Gradient(HashLattice(ix, iz, seed), dx, dz);
+    float n10 = Gradient(HashLattice(ix + 1, iz, seed), dx - 1.0f, dz);
+    float n01 = Gradient(HashLattice(ix, iz + 1, seed), dx, dz - 1.0f);
+    float n11 = Gradient(HashLattice(ix + 1, iz + 1, seed), dx - 1.0f, dz - 1.0f);
+
+    float u = Fade(dx), v = Fade(dz);
+    float nx0 = n00 + u * (n10 - n00);
+    float nx1 = n01 + u * (n11 - n01);
+    return nx0 + v * (nx1 - nx0);
+}
+
+inline uint32_t OctaveSeed(uint32_t seed, int octave) {
+    return seed + static_cast<uint32_t>(octave) * 0x9e3779b9u;
+}
+
+float TerrainNoise(float x, float z, uint32_t seed) {
+    float sum = 0.0f, amplitude = 1.0f, frequency = TERRAIN_FREQUENCY;
+    for (int octave = 0; octave < TERRAIN_OCTAVES; octave++) {
+        sum = sum + amplitude * GradientNoise(x * frequency, z * frequency, OctaveSeed(seed, octave));
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return sum;
+}
+
+#if HAS_SSE2
+// SSE2 has no 32-bit multiply-low, so build one from two 32x32->64 multiplies
+inline __m128i MulLo32(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+inline __m128i HashLattice4(__m128i x, __m128i z, __m128i seed) {
+    __m128i h = _mm_xor_si128(_mm_xor_si128(MulLo32(x, _mm_set1_epi32(0x27d4eb2d)),
+                                            MulLo32(z, _mm_set1_epi32(0x165667b1))), seed);
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+    h = MulLo32(h, _mm_set1_epi32(0x2c1b3c6d));
+    return _mm_xor_si128(h, _mm_srli_epi32(h, 12));
+}
+
+inline __m128 Gradient4(__m128i h, __m128 dx, __m128 dz) {
+    // Hash bits 0 and 1 flip the sign bits of dx and dz
+    __m128i one = _mm_set1_epi32(1);
+    __m128i signX = _mm_slli_epi32(_mm_and_si128(h, one), 31);
+    __m128i signZ = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(h, 1), one), 31);
+    return _mm_add_ps(_mm_xor_ps(dx, _mm_castsi128_ps(signX)), _mm_xor_ps(dz, _mm_castsi128_ps(signZ)));
+}
+
+inline __m128 Fade4(__m128 t) {
+    __m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))),
+                              _mm_set1_ps(10.0f));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+// floorf for values well inside the int range
+inline __m128 Floor4(__m128 x) {
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+}
+
+__m128 GradientNoise4(__m128 x, __m128 z, __m128i seed) {
+    __m128 fx = Floor4(x), fz = Floor4(z);
+    __m128i ix = _mm_cvttps_epi32(fx), iz = _mm_cvttps_epi32(fz);
+    __m128i ix1 = _mm_add_epi32(ix, _mm_set1_epi32(1)), iz1 = _mm_add_epi32(iz, _mm_set1_epi32(1));
+    __m128 dx = _mm_sub_ps(x, fx), dz = _mm_sub_ps(z, fz);
+    __m128 dx1 = _mm_sub_ps(dx, _mm_set1_ps(1.0f)), dz1 = _mm_sub_ps(dz, _mm_set1_ps(1.0f));
+
+    __m128 n00 = Gradient4(HashLattice4(ix, iz, seed), dx, dz);
+    __m128 n10 = Gradient4(HashLattice4(ix1, iz, seed), dx1, dz);
+    __m128 n01 = Gradient4(HashLattice4(ix, iz1, seed), dx, dz1);
+    __m128 n11 = Gradient4(HashLattice4(ix1, iz1, seed), dx1, dz1);
+
+    __m128 u = Fade4(dx), v = Fade4(dz);
+    __m128 nx0 = _mm_add_ps(n00, _mm_mul_ps(u, _mm_sub_ps(n10, n00)));
+    __m128 nx1 = _mm_add_ps(n01, _mm_mul_ps(u, _mm_sub_ps(n11, n01)));
+    return _mm_add_ps(nx0, _mm_mul_ps(v, _mm_sub_ps(nx1, nx0)));
+}
+
+__m128 TerrainNoise4(__m128 x, __m128 z, uint32_t seed) {
+    __m128 sum = _mm_setzero_ps();
+    float amplitude = 1.0f, frequency = TERRAIN_FREQUENCY;
+    for (int octave = 0; octave < TERRAIN_OCTAVES; octave++) {
+        __m128 f = _mm_set1_ps(frequency);
+        __m128i octaveSeed = _mm_set1_epi32(static_cast<int>(OctaveSeed(seed, octave)));
+        __m128 n = GradientNoise4(_mm_mul_ps(x, f), _mm_mul_ps(z, f), octaveSeed);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(amplitude), n));
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return sum;
+}
+#endif
+
+inline int NoiseToHeight(float noise) {
+    int height = TERRAIN_BASE + static_cast<int>(floorf(noise * TERRAIN_AMPLITUDE));
+    return std::max(1, std::min(WORLD_HEIGHT - 8, height));
+}
+
+// Ground heights for a row of count columns starting at world (x0, z)
+void TerrainHeightRow(int x0, int z, int count, uint32_t seed, int* heights) {
+    int i = 0;
+#if HAS_SSE2
+    __m128 zs = _mm_set1_ps(static_cast<float>(z));
+    for (; i + 4 <= count; i += 4) {
+        __m128 xs = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x0 + i), _mm_set_epi32(3, 2, 1, 0)));
+        float noise[4];
+        _mm_storeu_ps(noise, TerrainNoise4(xs, zs, seed));
+        for (int lane = 0; lane < 4; lane++) heights[i + lane] = NoiseToHeight(noise[lane]);
+    }
+#endif
+    for (; i < count; i++) {
+        heights[i] = NoiseToHeight(TerrainNoise(static_cast<float>(x0 + i), static_cast<float>(z), seed));
+    }
+}
+
+inline bool HasTree(int x, int z, int height, uint32_t seed) {
+    if (height <= SEA_LEVEL) return false;
+    return HashLattice(x, z, seed ^ 0x5bd1e995u) % TREE_CHANCE == 0;
+}
+
+int TerrainHeight(int x, int z, uint32_t seed) {
+    return NoiseToHeight(TerrainNoise(static_cast<float>(x), static_cast<float>(z), seed));
+}
+
+// A simple house in view of the starting camera
+const int HOUSE_X = 16;
+const int HOUSE_Z = 16;
+
+const int COLUMN_CHUNKS = (WORLD_HEIGHT + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+// Fills one column of COLUMN_CHUNKS chunks, bottom first. Only blocks inside
+// the column are written and nothing else is shared, so columns can be
+// generated on any thread in any order.
+void GenerateColumn(Chunk* const* column, int cx, int cz, uint32_t seed) {
+    const int BORDER = 1; // Leaves reach one block past their trunk
+    const int SPAN = CHUNK_SIZE + 2 * BORDER;
+
+    int baseX = cx * CHUNK_SIZE, baseZ = cz * CHUNK_SIZE;
+    auto setBlock = [column](int lx, int y, int lz, BlockType type) {
+        if (lx < 0 || lx >= CHUNK_SIZE || lz < 0 || lz >= CHUNK_SIZE || y < 0 || y >= WORLD_HEIGHT) return;
+        column[y >> CHUNK_SHIFT]->Set(lx, y & CHUNK_MASK, lz, type);
+    };
+    auto getBlock = [column](int lx, int y, int lz) {
+        return column[y >> CHUNK_SHIFT]->Get(lx, y & CHUNK_MASK, lz);
+    };
+
+    // Heights including a border, for trees whose leaves hang into this column
+    int heights[SPAN][SPAN];
+    for (int row = 0; row < SPAN; row++) {
+        TerrainHeightRow(baseX - BORDER, baseZ - BORDER + row, SPAN, seed, heights[row]);
+    }
+
+    for (int lz = 0; lz < CHUNK_SIZE; lz++) {
+        for (int lx = 0; lx < CHUNK_SIZE; lx++) {
+            int height = heights[lz + BORDER][lx + BORDER];
+
+            // Bedrock, stone, then three layers of dirt under grass (sand at the shore)
+            setBlock(lx, 0, lz, BlockType::BLOCK_STONE);
+            for (int y = 1; y < height; y++) {
+                setBlock(lx, y, lz, y < height - 3 ? BlockType::BLOCK_STONE : BlockType::BLOCK_DIRT);
+            }
+            setBlock(lx, height, lz, height <= SEA_LEVEL + 1 ? BlockType::BLOCK_SAND : BlockType::BLOCK_GRASS);
+
+            for (int y = height + 1; y <= SEA_LEVEL; y++) {
+                setBlock(lx, y, lz, BlockType::BLOCK_WATER);
+            }
+        }
+    }
+
+    // Trunks first, then leaves only into air, so overlapping trees come out
+    // the same in any order
+    for (int pass = 0; pass < 2; pass++) {
+        for (int tz = -BORDER; tz < CHUNK_SIZE + BORDER; tz++) {
+            for (int tx = -BORDER; tx < CHUNK_SIZE + BORDER; tx++) {
+                int height = heights[tz + BORDER][tx + BORDER];
+                if (!HasTree(baseX + tx, baseZ + tz, height, seed)) continue;
+
+                if (pass == 0) {
+                    for (int y = height + 1; y <= height + 4; y++) setBlock(tx, y, tz, BlockType::BLOCK_WOOD);
+                    continue;
+                }
+
+                // Tree leaves (simple cube)
+                for (int dy = 0; dy <= 2; dy++) {
+                    for (int dz = -1; dz <= 1; dz++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int lx = tx + dx, lz = tz + dz, y = height + 4 + dy;
+                            if (lx < 0 || lx >= CHUNK_SIZE || lz < 0 || lz >= CHUNK_SIZE || y >= WORLD_HEIGHT) continue;
+                            if (getBlock(lx, y, lz) == BlockType::BLOCK_AIR) {
+                                setBlock(lx, y, lz, BlockType::BLOCK_LEAVES);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // The house, if any of it falls in this column (setBlock clips the rest)
+    int houseX = HOUSE_X - baseX;
+    int houseZ = HOUSE_Z - baseZ;
+    if (houseX < -1 || houseX > CHUNK_SIZE || houseZ < -1 || houseZ > CHUNK_SIZE) return;
+    int groundY = heights[houseZ + BORDER][houseX + BORDER];
+
+    // Clear the space it stands in
+    for (int y = groundY + 1; y <= groundY + 3; y++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dz = -1; dz <= 1; dz++) {
+                setBlock(houseX + dx, y, houseZ + dz, BlockType::BLOCK_AIR);
+            }
+        }
+    }
+
+    // House foundation (3x3)
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            setBlock(houseX + dx, groundY, houseZ + dz, BlockType::BLOCK_BRICK);
+        }
+    }
+
+    // House walls
+    for (int y = groundY + 1; y <= groundY + 2; y++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dz = -1; dz <= 1; dz++) {
+                if (abs(dx) == 1 || abs(dz) == 1) { // Only walls (perimeter)
+                    // Windows on middle row
+                    if (y == groundY + 2 && (dx == 0 || dz == 0)) {
+                        setBlock(houseX + dx, y, houseZ + dz, BlockType::BLOCK_GLASS);
+                    }
+                    else {
+                        setBlock(houseX + dx, y, houseZ + dz, BlockType::BLOCK_BRICK);
+                    }
+                }
+            }
+        }
+    }
+
+    // Roof
+    setBlock(houseX, groundY + 3, houseZ, BlockType::BLOCK_WOOD);
+}
+
+// ==================== REGION FILES ====================
+// Edited chunks are saved in region files of REGION_SIZE x REGION_SIZE chunk
+// columns. A file is a header, an entry table and the RLE-compressed chunks:
+//
+//   RegionHeader | RegionEntry[count] | chunk data ...
+//
+// Files are memory mapped and only the entry table is read when a region is
+// opened; chunk data is decompressed when its column streams in. Unedited
+// chunks are never saved, since the seed regenerates them exactly.
+const int REGION_SHIFT = 4;
+const uint32_t REGION_MAGIC = 0x31525856; // "VXR1"
+
+struct RegionHeader {
+    uint32_t magic;
+    uint32_t count;
+};
+
+struct RegionEntry {
+    int32_t x, y, z;  // Chunk coordinate
+    uint32_t offset;  // From the start of the file
+    uint32_t size;    // Compressed bytes
+};
+
+// Read-only view of a whole file
+class MappedFile {
+private:
+    const uint8_t* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file, mapping;
+#else
+    int fd;
+#endif
+
+public:
+#ifdef _WIN32
+    MappedFile() : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(NULL) {}
+#else
+    MappedFile() : data(nullptr), size(0), fd(-1) {}
+#endif
+    ~MappedFile() { Close(); }
+
+    bool Open(const std::string& path) {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            Close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping) {
+            Close();
+            return false;
+        }
+        data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            Close();
+            return false;
+        }
+        void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        data = view != MAP_FAILED ? static_cast<const uint8_t*>(view) : nullptr;
+        size = static_cast<size_t>(info.st_size);
+#endif
+        if (!data) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+        if (fd >= 0) close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const uint8_t* Data() const { return data; }
+    size_t Size() const { return size; }
+};
+
+// Runs of (block type, run length - 1) byte pairs over the chunk in Index order.
+// Flowing water keeps its level in the top four bits of the type byte.
+const int FLOW_LEVEL_SHIFT = 4;
+static_assert(static_cast<int>(BlockType::BLOCK_COUNT) <= 1 << FLOW_LEVEL_SHIFT, "Block types must fit below the level bits");
+
+void CompressChunk(const Chunk& chunk, std::vector<uint8_t>& out) {
+    uint8_t codes[CHUNK_VOLUME];
+    for (int i = 0; i < CHUNK_VOLUME; i++) codes[i] = static_cast<uint8_t>(chunk.blocks.Get(i));
+    for (const auto& flow : chunk.flowLevels) codes[flow.first] |= static_cast<uint8_t>(flow.second << FLOW_LEVEL_SHIFT);
+
+    int i = 0;
+    while (i < CHUNK_VOLUME) {
+        uint8_t code = codes[i];
+        int run = 1;
+        while (run < 256 && i + run < CHUNK_VOLUME && codes[i + run] == code) run++;
+        out.push_back(code);
+        out.push_back(static_cast<uint8_t>(run - 1));
+        i += run;
+    }
+}
+
+bool DecompressChunk(const uint8_t* data, size_t size, Chunk& chunk) {
+    int i = 0;
+    for (size_t pos = 0; pos + 1 < size; pos += 2) {
+        int type = data[pos] & ((1 << FLOW_LEVEL_SHIFT) - 1), level = data[pos] >> FLOW_LEVEL_SHIFT;
+        int run = data[pos + 1] + 1;
+        if (type >= static_cast<int>(BlockType::BLOCK_COUNT) || i + run > CHUNK_VOLUME) return false;
+        if (level > 0 && type != static_cast<int>(BlockType::BLOCK_WATER)) return false;
+        for (int end = i + run; i < end; i++) {
+            chunk.Set(i & CHUNK_MASK, i >> (2 * CHUNK_SHIFT), (i >> CHUNK_SHIFT) & CHUNK_MASK,
+                      static_cast<BlockType>(type));
+            if (level > 0) chunk.flowLevels.push_back({ static_cast<uint16_t>(i), static_cast<uint8_t>(level) });
+        }
+    }
+    return i == CHUNK_VOLUME;
+}
+
+// All access goes through one mutex: streaming threads load while the UI
+// thread saves.
+class RegionStore {
+private:
+    struct Region {
+        MappedFile file;
+        // Entries grouped by chunk column (y = 0)
+        std::unordered_map<ChunkCoord, std::vector<RegionEntry>, ChunkCoordHash> columns;
+    };
+
+    std::string directory;
+    std::mutex mutex;
+    std::unordered_map<ChunkCoord, std::unique_ptr<Region>, ChunkCoordHash> regions; // Keyed by region (y = 0)
+
+    static ChunkCoord RegionOf(int cx, int cz) {
+        return { cx >> REGION_SHIFT, 0, cz >> REGION_SHIFT };
+    }
+
+    std::string RegionPath(const ChunkCoord& region) const {
+        return directory + "/r." + std::to_string(region.x) + "." + std::to_string(region.z) + ".vxr";
+    }
+
+    // Maps a region file and reads its entry table. Regions without a file
+    // are cached empty too, so missing files are only looked for once.
+    Region& GetRegion(const ChunkCoord& key) {
+        std::unique_ptr<Region>& slot = regions[key];
+        if (slot) return *slot;
+        slot.reset(new Region());
+
+        Region& region = *slot;
+        if (!region.file.Open(RegionPath(key))) return region;
+
+        const uint8_t* data = region.file.Data();
+        size_t size = region.file.Size();
+        RegionHeader header;
+        if (size < sizeof(header)) return region;
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != REGION_MAGIC || header.count > (size - sizeof(header)) / sizeof(RegionEntry)) {
+            return region;
+        }
+
+        for (uint32_t i = 0; i < header.count; i++) {
+            RegionEntry entry;
+            memcpy(&entry, data + sizeof(header) + i * sizeof(RegionEntry), sizeof(entry));
+            if (static_cast<uint64_t>(entry.offset) + entry.size > size) continue;
+            region.columns[{ entry.x, 0, entry.z }].push_back(entry);
+        }
+        return region;
+    }
+
+public:
+    // Selects the save directory; it is created on the first save. An empty
+    // path turns saving off: nothing is loaded and edits are dropped on unload.
+    void Open(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        regions.clear();
+        directory = path;
+    }
+
+    // Replaces chunks of a freshly generated column with their saved versions,
+    // and adds saved chunks that lie outside the generated height
+    void LoadColumn(int cx, int cz, std::vector<std::unique_ptr<Chunk>>& chunks) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (directory.empty()) return;
+        Region& region = GetRegion(RegionOf(cx, cz));
+        auto it = region.columns.find({ cx, 0, cz });
+        if (it == region.columns.end()) return;
+
+        for (const RegionEntry& entry : it->second) {
+            std::unique_ptr<Chunk> chunk(new Chunk({ entry.x, entry.y, entry.z }));
+            if (!DecompressChunk(region.file.Data() + entry.offset, entry.size, *chunk)) continue;
+
+            bool replaced = false;
+            for (auto& existing : chunks) {
+                if (existing->coord == chunk->coord) {
+                    existing = std::move(chunk);
+                    replaced = true;
+                    break;
+                }
+            }
+            if (!replaced) chunks.push_back(std::move(chunk));
+        }
+    }
+
+    // Writes the chunks into their region files and clears their unsavedEdits
+    // flags. Each touched region is rewritten once: kept entries are copied
+    // from the old mapping into a temporary file that then replaces it.
+    bool Save(const std::vector<Chunk*>& chunks) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (chunks.empty() || directory.empty()) return true;
+#ifdef _WIN32
+        CreateDirectoryA(directory.c_str(), NULL);
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+
+        std::unordered_map<ChunkCoord, std::vector<Chunk*>, ChunkCoordHash> byRegion;
+        for (Chunk* chunk : chunks) byRegion[RegionOf(chunk->coord.x, chunk->coord.z)].push_back(chunk);
+
+        bool ok = true;
+        std::vector<RegionEntry> entries;
+        std::vector<uint8_t> body;
+        for (auto& group : byRegion) {
+            Region& region = GetRegion(group.first);
+            entries.clear();
+            body.clear();
+
+            // New chunk data first
+            for (Chunk* chunk : group.second) {
+                RegionEntry entry = { chunk->coord.x, chunk->coord.y, chunk->coord.z,
+                                      static_cast<uint32_t>(body.size()), 0 };
+                CompressChunk(*chunk, body);
+                entry.size = static_cast<uint32_t>(body.size()) - entry.offset;
+                entries.push_back(entry);
+            }
+
+            // Then every old chunk that wasn't just replaced
+            for (const auto& column : region.columns) {
+                for (const RegionEntry& old : column.second) {
+                    bool replaced = false;
+                    for (Chunk* chunk : group.second) {
+                        if (chunk->coord == ChunkCoord{ old.x, old.y, old.z }) replaced = true;
+                    }
+                    if (replaced) continue;
+
+                    RegionEntry entry = old;
+                    entry.offset = static_cast<uint32_t>(body.size());
+                    body.insert(body.end(), region.file.Data() + old.offset,
+                                region.file.Data() + old.offset + old.size);
+                    entries.push_back(entry);
+                }
+            }
+
+            // Offsets so far are relative to the data block
+            RegionHeader header = { REGION_MAGIC, static_cast<uint32_t>(entries.size()) };
+            uint32_t dataStart = static_cast<uint32_t>(sizeof(header) + entries.size() * sizeof(RegionEntry));
+            for (RegionEntry& entry : entries) entry.offset += dataStart;
+
+            std::string path = RegionPath(group.first);
+            std::string tempPath = path + ".tmp";
+            FILE* file = nullptr;
+#ifdef _WIN32
+            if (fopen_s(&file, tempPath.c_str(), "wb") != 0) file = nullptr;
+#else
+            file = fopen(tempPath.c_str(), "wb");
+#endif
+            bool written = file != nullptr;
+            if (file) {
+                written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                          fwrite(entries.data(), sizeof(RegionEntry), entries.size(), file) == entries.size() &&
+                          fwrite(body.data(), 1, body.size(), file) == body.size();
+                written = fclose(file) == 0 && written;
+            }
+
+            // The old mapping must be gone before the file can be replaced
+            regions.erase(group.first);
+#ifdef _WIN32
+            written = written && MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+            written = written && rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+            if (!written) {
+                ok = false;
+                continue;
+            }
+            for (Chunk* chunk : group.second) {
+                chunk->unsavedEdits = false;
+                chunk->flowLevels.clear();
+            }
+        }
+        return ok;
+    }
+};
+
+RegionStore regionStore;
+
+// ==================== LIGHTING ====================
+// Sky light and block light (from lamps) spread breadth first through
+// see-through blocks, dropping one level per block; full sky light also
+// falls straight down without loss. Edits relight incrementally: light that
+// came through or from the changed block is cleared by a removal BFS, then
+// the cleared area is refilled from the light still bordering it. Chunks
+// whose light changes are remeshed, since faces are shaded at mesh time.
+// New columns are lit on their own on the streaming thread; the UI thread
+// only lets light cross the border to the columns already loaded.
+struct LightStats {
+    int columns;
+    double ms;     // Lighting new columns, on the streaming threads
+    double joinMs; // Spreading across column borders, on the UI thread
+} lightStats = {};
+
+class LightEngine {
+private:
+    struct LightNode {
+        int x, y, z;
+        int level; // Level before removal; unused while spreading
+    };
+
+    // Either the whole store, or (store == nullptr) one column on its own
+    ChunkStore* store;
+    std::vector<Chunk*> column; // Indexed by chunk y
+    int columnX, columnZ;
+    std::vector<LightNode> spreadQueue, removeQueue;
+
+    // Last chunk looked up; BFS neighbours are nearly always in the same one
+    ChunkCoord cachedCoord;
+    Chunk* cachedChunk;
+
+    void Begin(ChunkStore* target) {
+        store = target;
+        cachedCoord = { INT32_MIN, INT32_MIN, INT32_MIN };
+        cachedChunk = nullptr;
+    }
+
+    Chunk* Find(int x, int y, int z) {
+        ChunkCoord coord = ChunkStore::ToChunkCoord(x, y, z);
+        if (coord != cachedCoord) {
+            cachedCoord = coord;
+            if (store) {
+                cachedChunk = store->GetChunk(coord);
+            }
+            else {
+                bool inside = coord.x == columnX && coord.z == columnZ && coord.y >= 0 &&
+                              coord.y < static_cast<int>(column.size());
+                cachedChunk = inside ? column[coord.y] : nullptr;
+            }
+        }
+        return cachedChunk;
+    }
+
+    // Light is baked into the meshes of this chunk and of any chunk across
+    // the border from the block
+    void MarkChanged(Chunk& chunk, int lx, int ly, int lz) {
+        chunk.meshDirty = true;
+        if (store && (lx == 0 || ly == 0 || lz == 0 || lx == CHUNK_MASK || ly == CHUNK_MASK || lz == CHUNK_MASK)) {
+            store->MarkMeshDirty(chunk.coord, lx, ly, lz);
+            cachedCoord = { INT32_MIN, INT32_MIN, INT32_MIN };
+        }
+    }
+
+    int LevelAt(int x, int y, int z, int channel) {
+        Chunk* chunk = Find(x, y, z);
+        if (!chunk) return 0;
+        return LightLevel(chunk->LightAt(Chunk::Index(x & CHUNK_MASK, y & CHUNK_MASK, z & CHUNK_MASK)), channel);
+    }
+
+    // Level a block passes on to its neighbour in direction d
+    static int PassedOn(int level, int channel, int d) {
+        if (channel == LIGHT_SKY && level == LIGHT_MAX && d == FACE_BOTTOM) return LIGHT_MAX;
+        return level - 1;
+    }
+
+    void Spread(int channel) {
+        for (size_t head = 0; head < spreadQueue.size(); head++) {
+            LightNode node = spreadQueue[head];
+            int level = LevelAt(node.x, node.y, node.z, channel); // May have risen since it was queued
+            if (level <= 1) continue;
+
+            for (int d = 0; d < FACE_COUNT; d++) {
+                const FaceDirInfo& info = FaceDirs[d];
+                int x = node.x + info.dx, y = node.y + info.dy, z = node.z + info.dz;
+                Chunk* chunk = Find(x, y, z);
+                if (!chunk) continue;
+
+                int lx = x & CHUNK_MASK, ly = y & CHUNK_MASK, lz = z & CHUNK_MASK;
+                int index = Chunk::Index(lx, ly, lz);
+                if (!IsTransparent(chunk->blocks.Get(index))) continue;
+
+                int next = PassedOn(level, channel, d);
+                uint8_t packed = chunk->LightAt(index);
+                if (LightLevel(packed, channel) >= next) continue;
+                chunk->SetLight(index, WithLightLevel(packed, channel, next));
+                MarkChanged(*chunk, lx, ly, lz);
+                spreadQueue.push_back({ x, y, z, 0 });
+            }
+        }
+        spreadQueue.clear();
+    }
+
+    // Clears everything lit through the queued blocks (already set to zero).
+    // Neighbours lit from elsewhere are queued to spread back into the gap.
+    void Remove(int channel) {
+        for (size_t head = 0; head < removeQueue.size(); head++) {
+            LightNode node = removeQueue[head];
+            for (int d = 0; d < FACE_COUNT; d++) {
+                const FaceDirInfo& info = FaceDirs[d];
+                int x = node.x + info.dx, y = node.y + info.dy, z = node.z + info.dz;
+                Chunk* chunk = Find(x, y, z);
+                if (!chunk) continue;
+
+                int lx = x & CHUNK_MASK, ly = y & CHUNK_MASK, lz = z & CHUNK_MASK;
+                int index = Chunk::Index(lx, ly, lz);
+                uint8_t packed = chunk->LightAt(index);
+                int level = LightLevel(packed, channel);
+                if (level == 0) continue;
+
+                bool litByNode = level < node.level || PassedOn(node.level, channel, d) == level;
+                if (litByNode && level > (channel == LIGHT_BLOCK ? LightEmission(chunk->blocks.Get(index)) : 0)) {
+                    chunk->SetLight(index, WithLightLevel(packed, channel, 0));
+                    MarkChanged(*chunk, lx, ly, lz);
+                    removeQueue.push_back({ x, y, z, level });
+                }
+                else {
+                    spreadQueue.push_back({ x, y, z, 0 });
+                }
+            }
+        }
+        removeQueue.clear();
+    }
+
+    // Queues (x, y, z) when its light would raise the see-through block (tx, y, tz)
+    void QueueIfBrighter(int x, int y, int z, int tx, int tz, int channel) {
+        int level = LevelAt(x, y, z, channel);
+        if (level <= 1) return;
+        const Chunk* target = Find(tx, y, tz);
+        if (!target) return;
+        int index = Chunk::Index(tx & CHUNK_MASK, y & CHUNK_MASK, tz & CHUNK_MASK);
+        if (IsTransparent(target->blocks.Get(index)) && LightLevel(target->LightAt(index), channel) < level - 1) {
+            spreadQueue.push_back({ x, y, z, 0 });
+        }
+    }
+
+    // Lights the chunks in 'column' without looking outside it: sky light
+    // falls down each block column, then both channels spread through it
+    void LightAlone(int cx, int cz) {
+        Begin(nullptr);
+        columnX = cx;
+        columnZ = cz;
+        int top = static_cast<int>(column.size());
+
+        for (int lz = 0; lz < CHUNK_SIZE; lz++) {
+            for (int lx = 0; lx < CHUNK_SIZE; lx++) {
+                int sky = LIGHT_MAX;
+                for (int cy = top - 1; cy >= 0; cy--) {
+                    Chunk* chunk = column[cy];
+                    if (!chunk) continue;
+                    for (int ly = CHUNK_MASK; ly >= 0; ly--) {
+                        int index = Chunk::Index(lx, ly, lz);
+                        BlockType type = chunk->blocks.Get(index);
+                        if (!IsTransparent(type)) sky = 0;
+                        chunk->SetLight(index, static_cast<uint8_t>(sky << 4 | LightEmission(type)));
+                    }
+                }
+            }
+        }
+
+        // Seed with the lamps, and with every lit block next to a darker
+        // see-through block sideways. Straight up and down, sky light is
+        // already as bright as it gets after the pass above.
+        int baseX = cx * CHUNK_SIZE, baseZ = cz * CHUNK_SIZE;
+        for (int channel = 0; channel < LIGHT_CHANNELS; channel++) {
+            for (int y = 0; y < top * CHUNK_SIZE; y++) {
+                for (int z = baseZ; z < baseZ + CHUNK_SIZE; z++) {
+                    for (int x = baseX; x < baseX + CHUNK_SIZE; x++) {
+                        if (channel == LIGHT_BLOCK) {
+                            if (LevelAt(x, y, z, channel) > 1) spreadQueue.push_back({ x, y, z, 0 });
+                            continue;
+                        }
+                        for (int d = FACE_FRONT; d < FACE_COUNT; d++) {
+                            size_t queued = spreadQueue.size();
+                            QueueIfBrighter(x, y, z, x + FaceDirs[d].dx, z + FaceDirs[d].dz, channel);
+                            if (spreadQueue.size() > queued) break;
+                        }
+                    }
+                }
+            }
+            Spread(channel);
+        }
+
+        // Open sky above and solid rock below usually end up uniform
+        for (Chunk* chunk : column) {
+            if (chunk) chunk->CompactLight();
+        }
+    }
+
+    // Queues a block and its neighbours so their light spreads again
+    void QueueAround(int x, int y, int z) {
+        spreadQueue.push_back({ x, y, z, 0 });
+        for (int d = 0; d < FACE_COUNT; d++) {
+            const FaceDirInfo& info = FaceDirs[d];
+            spreadQueue.push_back({ x + info.dx, y + info.dy, z + info.dz, 0 });
+        }
+    }
+
+public:
+    LightEngine() : store(nullptr), columnX(0), columnZ(0), cachedCoord{ 0, 0, 0 }, cachedChunk(nullptr) {}
+
+    // Streaming thread: lights a freshly generated column as if nothing
+    // were loaded around it. Chunks below y = 0 are left unlit.
+    void LightNewColumn(std::vector<std::unique_ptr<Chunk>>& chunks) {
+        if (chunks.empty()) return;
+        column.clear();
+        for (auto& chunk : chunks) {
+            int cy = chunk->coord.y;
+            if (cy < 0) continue;
+            if (cy >= static_cast<int>(column.size())) column.resize(cy + 1, nullptr);
+            column[cy] = chunk.get();
+        }
+        LightAlone(chunks[0]->coord.x, chunks[0]->coord.z);
+    }
+
+    // Lights a column already in the store from scratch, e.g. after its
+    // blocks were replaced wholesale. Call JoinColumn once its neighbours
+    // are relit too.
+    void RelightColumn(ChunkStore& target, int cx, int cz) {
+        column.clear();
+        for (int cy = 0; cy < COLUMN_CHUNKS || target.GetChunk({ cx, cy, cz }); cy++) {
+            column.push_back(target.GetChunk({ cx, cy, cz }));
+        }
+        LightAlone(cx, cz);
+        for (Chunk* chunk : column) {
+            if (chunk) target.MarkNeighborsDirty(chunk->coord);
+        }
+    }
+
+    // UI thread: lets light cross the four sides between a lit column and
+    // the loaded columns around it, in both directions
+    void JoinColumn(ChunkStore& target, int cx, int cz) {
+        Begin(&target);
+        int top = COLUMN_CHUNKS;
+        while (store->GetChunk({ cx, top, cz })) top++;
+
+        int baseX = cx * CHUNK_SIZE, baseZ = cz * CHUNK_SIZE;
+        for (int channel = 0; channel < LIGHT_CHANNELS; channel++) {
+            for (int y = 0; y < top * CHUNK_SIZE; y++) {
+                for (int i = 0; i < CHUNK_SIZE; i++) {
+                    // Inside block, then the block across the border from it
+                    const int pairs[4][4] = {
+                        { baseX, baseZ + i, baseX - 1, baseZ + i },
+                        { baseX + CHUNK_MASK, baseZ + i, baseX + CHUNK_SIZE, baseZ + i },
+                        { baseX + i, baseZ, baseX + i, baseZ - 1 },
+                        { baseX + i, baseZ + CHUNK_MASK, baseX + i, baseZ + CHUNK_SIZE },
+                    };
+                    for (const auto& pair : pairs) {
+                        QueueIfBrighter(pair[0], y, pair[1], pair[2], pair[3], channel);
+                        QueueIfBrighter(pair[2], y, pair[3], pair[0], pair[1], channel);
+                    }
+                }
+            }
+            Spread(channel);
+        }
+    }
+
+    // Relights around (x, y, z) after its block changed from 'before'
+    void BlockChanged(ChunkStore& target, int x, int y, int z, BlockType before) {
+        BlockType after = target.GetBlock(x, y, z);
+        if (IsTransparent(before) == IsTransparent(after) && LightEmission(before) == LightEmission(after)) {
+            return; // Light passes and shines exactly as before
+        }
+
+        Begin(&target);
+        Chunk* chunk = Find(x, y, z);
+        if (!chunk) return;
+        int lx = x & CHUNK_MASK, ly = y & CHUNK_MASK, lz = z & CHUNK_MASK;
+        int index = Chunk::Index(lx, ly, lz);
+
+        for (int channel = 0; channel < LIGHT_CHANNELS; channel++) {
+            chunk = Find(x, y, z);
+            int old = LightLevel(chunk->LightAt(index), channel);
+            int emitted = channel == LIGHT_BLOCK ? LightEmission(after) : 0;
+            chunk->SetLight(index, WithLightLevel(chunk->LightAt(index), channel, emitted));
+            MarkChanged(*chunk, lx, ly, lz);
+
+            if (old > 0) removeQueue.push_back({ x, y, z, old });
+            if (IsTransparent(after)) QueueAround(x, y, z);
+            else if (emitted > 0) spreadQueue.push_back({ x, y, z, 0 });
+
+            Remove(channel);
+            Spread(channel);
+        }
+    }
+};
+
+LightEngine lightEngine;
+
+// ==================== CHUNK STREAMING ====================
+// Chunk columns are generated on background threads in a circle of
+// renderDistance around the camera and dropped once they fall outside it.
+// The UI thread only swaps in a new request list and picks up finished
+// columns, so it never waits on generation; columns that are not ready yet
+// are simply missing from the world and don't render.
+struct ColumnResult {
+    ChunkCoord column; // y is unused
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    double ms;         // Generation time on the streaming thread
+    double lightMs;    // Of which lighting the column
+};
+
+class ChunkStreamer {
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<ChunkCoord> queue;                          // Most wanted column last
+    std::unordered_set<ChunkCoord, ChunkCoordHash> inFlight; // Taken by a thread, not yet collected
+    std::vector<ColumnResult> ready;
+    uint32_t seed;
+    bool quit;
+
+    void WorkerLoop() {
+        LightEngine columnLight; // Its queues are reused from column to column
+        for (;;) {
+            ChunkCoord column;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !queue.empty(); });
+                if (quit) return;
+                column = queue.back();
+                queue.pop_back();
+                inFlight.insert(column);
+            }
+
+            double start = GetTimeMs();
+            ColumnResult result;
+            result.column = column;
+            Chunk* chunks[COLUMN_CHUNKS];
+            for (int cy = 0; cy < COLUMN_CHUNKS; cy++) {
+                result.chunks.emplace_back(new Chunk({ column.x, cy, column.z }));
+                chunks[cy] = result.chunks[cy].get();
+            }
+            GenerateColumn(chunks, column.x, column.z, seed);
+
+            // Saved edits replace the generated chunks
+            regionStore.LoadColumn(column.x, column.z, result.chunks);
+            for (auto& chunk : result.chunks) chunk->blocks.Compact();
+
+            double lightStart = GetTimeMs();
+            columnLight.LightNewColumn(result.chunks);
+            result.lightMs = GetTimeMs() - lightStart;
+            result.ms = GetTimeMs() - start;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(std::move(result));
+        }
+    }
+
+public:
+    ChunkStreamer() : seed(0), quit(false) {}
+
+    ~ChunkStreamer() { Stop(); }
+
+    // Spawns threadCount generator threads (0 = half the hardware cores)
+    void Start(uint32_t worldSeed, int threadCount = 0) {
+        Stop();
+        if (threadCount <= 0) {
+            threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / 2);
+        }
+        seed = worldSeed;
+        quit = false;
+        for (int i = 0; i < threadCount; i++) {
+            threads.emplace_back(&ChunkStreamer::WorkerLoop, this);
+        }
+    }
+
+    // Stops the threads and forgets every request and result
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) thread.join();
+        threads.clear();
+        queue.clear();
+        inFlight.clear();
+        ready.clear();
+    }
+
+    int ThreadCount() const { return static_cast<int>(threads.size()); }
+
+    // Replaces the pending requests; columns must be ordered least wanted first
+    void Request(const std::vector<ChunkCoord>& columns) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.clear();
+            for (const ChunkCoord& column : columns) {
+                if (!inFlight.count(column)) queue.push_back(column);
+            }
+        }
+        wake.notify_all();
+    }
+
+    // Moves out every finished column
+    void Collect(std::vector<ColumnResult>& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (ColumnResult& result : ready) {
+            inFlight.erase(result.column);
+            out.push_back(std::move(result));
+        }
+        ready.clear();
+    }
+
+    // Requests not yet collected, queued or being generated
+    int Pending() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return static_cast<int>(queue.size() + inFlight.size());
+    }
+};
+
+ChunkStreamer chunkStreamer;
+std::unordered_set<ChunkCoord, ChunkCoordHash> loadedColumns; // UI thread only
+
+// Flowing water levels travel with the chunks through the region files
+void StoreWaterLevels(Chunk& chunk);
+void AdoptWaterLevels(Chunk& chunk);
+void ForgetUnloadedWater();
+
+inline bool InStreamRange(int dx, int dz, int radius) {
+    return dx * dx + dz * dz <= radius * radius;
+}
+
+// Runs on the UI thread once per frame: takes in finished columns, unloads
+// far ones and re-requests missing ones. Returns how many are still missing.
+int StreamChunks() {
+    ChunkCoord center = ChunkStore::ToChunkCoord(
+        static_cast<int>(floorf(camera.x)), 0, static_cast<int>(floorf(camera.z)));
+    int keepRadius = renderDistance + 1; // Slack so columns don't flicker at the edge
+
+    static std::vector<ColumnResult> finished;
+    finished.clear();
+    chunkStreamer.Collect(finished);
+    for (ColumnResult& result : finished) {
+        terrainStats.chunks += COLUMN_CHUNKS;
+        terrainStats.ms += result.ms;
+        if (!InStreamRange(result.column.x - center.x, result.column.z - center.z, keepRadius)) continue;
+
+        for (auto& chunk : result.chunks) AdoptWaterLevels(*world.Insert(std::move(chunk)));
+        double joinStart = GetTimeMs();
+        lightEngine.JoinColumn(world, result.column.x, result.column.z);
+        lightStats.columns++;
+        lightStats.ms += result.lightMs;
+        lightStats.joinMs += GetTimeMs() - joinStart;
+        loadedColumns.insert(result.column);
+        worldRevision++;
+    }
+
+    // Unload whole columns, including any chunks built above the terrain.
+    // Edited chunks are written to their region files first; a column whose
+    // save failed stays loaded, and the save is retried on the next call.
+    static std::vector<Chunk*> unsaved;
+    static std::unordered_set<ChunkCoord, ChunkCoordHash> heldColumns;
+    unsaved.clear();
+    heldColumns.clear();
+    world.ForEachChunk([&center, keepRadius](Chunk& chunk) {
+        if (chunk.unsavedEdits && !InStreamRange(chunk.coord.x - center.x, chunk.coord.z - center.z, keepRadius)) {
+            unsaved.push_back(&chunk);
+        }
+    });
+    for (Chunk* chunk : unsaved) StoreWaterLevels(*chunk);
+    if (!unsaved.empty() && !regionStore.Save(unsaved)) {
+        for (Chunk* chunk : unsaved) {
+            if (chunk->unsavedEdits) heldColumns.insert({ chunk->coord.x, 0, chunk->coord.z });
+        }
+    }
+
+    auto unloads = [&center, keepRadius](const ChunkCoord& coord) {
+        return !InStreamRange(coord.x - center.x, coord.z - center.z, keepRadius) &&
+               !heldColumns.count({ coord.x, 0, coord.z });
+    };
+    world.RemoveIf([&unloads](const Chunk& chunk) { return unloads(chunk.coord); });
+    bool unloaded = false;
+    for (auto it = loadedColumns.begin(); it != loadedColumns.end();) {
+        if (unloads(*it)) {
+            it = loadedColumns.erase(it);
+            unloaded = true;
+        }
+        else {
+            ++it;
+        }
+    }
+    if (unloaded) ForgetUnloadedWater();
+
+    // Nearest columns first, favouring the ones in front of the camera
+    float forwardX = sinf(camera.yaw * 3.14159f / 180.0f);
+    float forwardZ = cosf(camera.yaw * 3.14159f / 180.0f);
+    static std::vector<std::pair<float, ChunkCoord>> wanted;
+    wanted.clear();
+    for (int dx = -renderDistance; dx <= renderDistance; dx++) {
+        for (int dz = -renderDistance; dz <= renderDistance; dz++) {
+            if (!InStreamRange(dx, dz, renderDistance)) continue;
+            ChunkCoord column = { center.x + dx, 0, center.z + dz };
+            if (loadedColumns.count(column)) continue;
+
+            float distance = sqrtf(static_cast<float>(dx * dx + dz * dz));
+            float facing = distance > 0.0f ? (dx * forwardX + dz * forwardZ) / distance : 1.0f;
+            wanted.push_back(std::make_pair(distance - 2.0f * facing, column));
+        }
+    }
+    std::sort(wanted.begin(), wanted.end(),
+              [](const std::pair<float, ChunkCoord>& a, const std::pair<float, ChunkCoord>& b) {
+                  return a.first > b.first;
+              });
+
+    static std::vector<ChunkCoord> requests;
+    requests.clear();
+    for (const auto& entry : wanted) requests.push_back(entry.second);
+    chunkStreamer.Request(requests);
+    return static_cast<int>(requests.size());
+}
+
+// Writes every edited chunk still in memory, e.g. before exiting
+void SaveWorld() {
+    std::vector<Chunk*> unsaved;
+    world.ForEachChunk([&unsaved](Chunk& chunk) {
+        if (chunk.unsavedEdits) unsaved.push_back(&chunk);
+    });
+    for (Chunk* chunk : unsaved) StoreWaterLevels(*chunk);
+    regionStore.Save(unsaved);
+}
+
+// ==================== WATER FLOW ====================
+// Water falls into air below it and, once resting on something solid, spreads
+// sideways one level weaker per block. Placed and generated water is a source
+// (level 0); flowing water keeps its level in a sparse map and dries up when
+// nothing stronger feeds it any more. Only cells in the active set are looked
+// at: a cell joins it when it or a neighbour changes and leaves it after one
+// update, so still water costs nothing. Each tick updates at most
+// WATER_TICK_BUDGET cells, chunk by chunk in parallel against the unchanged
+// world, then applies the changes in order on the calling thread.
+const int WATER_MAX_LEVEL = 7;          // Weakest flowing water; one step further is dry
+const int WATER_TICK_BUDGET = 4096;     // Active cells updated per tick
+const double WATER_TICK_MS = 200.0;
+const int WATER_DRY = -1;               // Change level that removes the water
+
+void EditBlock(int x, int y, int z, BlockType type);
+
+struct WaterStats {
+    int ticks;
+    int cellsUpdated;
+    double ms;
+} waterStats = {};
+
+class WaterFlow {
+private:
+    struct Cell {
+        int x, y, z;
+    };
+
+    struct Change {
+        int x, y, z;
+        int level; // 1..WATER_MAX_LEVEL, or WATER_DRY
+    };
+
+    std::unordered_map<uint64_t, uint8_t> levels; // Flowing water only
+    std::vector<Cell> active;
+    std::unordered_set<uint64_t> queued;          // Cells already in 'active'
+    std::vector<Cell> batch;
+    std::vector<std::vector<Change>> groupChanges;
+    std::vector<Change> changes;
+
+    // 26 bits each for x and z, 12 for y: unique within any reachable world
+    static uint64_t Key(int x, int y, int z) {
+        return (static_cast<uint64_t>(x & 0x3FFFFFF) << 38) | (static_cast<uint64_t>(y & 0xFFF) << 26) |
+               static_cast<uint64_t>(z & 0x3FFFFFF);
+    }
+
+    static int KeyX(uint64_t key) { return static_cast<int>(static_cast<int64_t>(key) >> 38); }
+    static int KeyZ(uint64_t key) { return static_cast<int>(static_cast<int64_t>(key << 38) >> 38); }
+
+    // Water never flows below the world or into columns that are not streamed in
+    static bool Loaded(int x, int y, int z) {
+        if (y < 0) return false;
+        ChunkCoord column = ChunkStore::ToChunkCoord(x, 0, z);
+        column.y = 0;
+        return loadedColumns.count(column) > 0;
+    }
+
+    int Level(int x, int y, int z) const {
+        auto it = levels.find(Key(x, y, z));
+        return it != levels.end() ? it->second : 0;
+    }
+
+    // Water here spreads sideways only if it cannot fall: it sits on a solid
+    // block or on still source water (a lake surface), not on a falling stream
+    bool Resting(int x, int y, int z) const {
+        BlockType below = world.GetBlock(x, y - 1, z);
+        if (below == BlockType::BLOCK_AIR) return false;
+        return below != BlockType::BLOCK_WATER || Level(x, y - 1, z) == 0;
+    }
+
+    // Read-only: what this cell does to itself and its neighbours this tick
+    void Evaluate(const Cell& cell, std::vector<Change>& out) const {
+        int x = cell.x, y = cell.y, z = cell.z;
+        if (world.GetBlock(x, y, z) != BlockType::BLOCK_WATER) return;
+        int level = Level(x, y, z);
+
+        if (level > 0) {
+            // Flowing water takes its level from the strongest water feeding it
+            int fed = WATER_MAX_LEVEL + 1;
+            if (world.GetBlock(x, y + 1, z) == BlockType::BLOCK_WATER) {
+                fed = 1;
+            }
+            else {
+                for (int dir = 0; dir < FACE_COUNT; dir++) {
+                    const FaceDirInfo& d = FaceDirs[dir];
+                    if (d.dy != 0) continue;
+                    int nx = x + d.dx, nz = z + d.dz;
+                    if (world.GetBlock(nx, y, nz) == BlockType::BLOCK_WATER && Resting(nx, y, nz)) {
+                        fed = std::min(fed, Level(nx, y, nz) + 1);
+                    }
+                }
+            }
+            if (fed != level) {
+                out.push_back({ x, y, z, fed > WATER_MAX_LEVEL ? WATER_DRY : fed });
+                return; // Spread once the new level is in place
+            }
+        }
+
+        BlockType below = world.GetBlock(x, y - 1, z);
+        if (below == BlockType::BLOCK_AIR) {
+            if (Loaded(x, y - 1, z)) out.push_back({ x, y - 1, z, 1 });
+            return;
+        }
+        if (!Resting(x, y, z) || level >= WATER_MAX_LEVEL) return;
+
+        for (int dir = 0; dir < FACE_COUNT; dir++) {
+            const FaceDirInfo& d = FaceDirs[dir];
+            if (d.dy != 0) continue;
+            int nx = x + d.dx, nz = z + d.dz;
+            BlockType next = world.GetBlock(nx, y, nz);
+            if (next == BlockType::BLOCK_AIR ? Loaded(nx, y, nz)
+                                             : next == BlockType::BLOCK_WATER && Level(nx, y, nz) > level + 1) {
+                out.push_back({ nx, y, nz, level + 1 });
+            }
+        }
+    }
+
+    void Apply(const Change& change) {
+        int x = change.x, y = change.y, z = change.z;
+        BlockType current = world.GetBlock(x, y, z);
+        if (change.level == WATER_DRY) {
+            if (current == BlockType::BLOCK_WATER && Level(x, y, z) > 0) EditBlock(x, y, z, BlockType::BLOCK_AIR);
+            return;
+        }
+
+        if (current == BlockType::BLOCK_AIR) {
+            EditBlock(x, y, z, BlockType::BLOCK_WATER);
+        }
+        else if (current != BlockType::BLOCK_WATER || Level(x, y, z) == 0) {
+            return; // Blocked, or a source that flowing water never overrides
+        }
+        else {
+            Wake(x, y, z);
+        }
+        levels[Key(x, y, z)] = static_cast<uint8_t>(change.level);
+
+        // The level is saved with the chunk, even when the block stayed water
+        Chunk* chunk = world.GetChunk(ChunkStore::ToChunkCoord(x, y, z));
+        if (chunk) chunk->unsavedEdits = true;
+    }
+
+public:
+    int ActiveCount() const { return static_cast<int>(active.size()); }
+
+    void Clear() {
+        levels.clear();
+        active.clear();
+        queued.clear();
+    }
+
+    // Queues a cell and its six neighbours for the next tick
+    void Wake(int x, int y, int z) {
+        for (int dir = -1; dir < FACE_COUNT; dir++) {
+            int cx = x, cy = y, cz = z;
+            if (dir >= 0) {
+                cx += FaceDirs[dir].dx;
+                cy += FaceDirs[dir].dy;
+                cz += FaceDirs[dir].dz;
+            }
+            if (queued.insert(Key(cx, cy, cz)).second) active.push_back({ cx, cy, cz });
+        }
+    }
+
+    // Lists the chunk's flowing water in chunk.flowLevels for the region file
+    void StoreLevels(Chunk& chunk) const {
+        chunk.flowLevels.clear();
+        int baseX = chunk.coord.x * CHUNK_SIZE, baseY = chunk.coord.y * CHUNK_SIZE, baseZ = chunk.coord.z * CHUNK_SIZE;
+        for (int i = 0; i < CHUNK_VOLUME; i++) {
+            if (chunk.blocks.Get(i) != BlockType::BLOCK_WATER) continue;
+            int level = Level(baseX + (i & CHUNK_MASK), baseY + (i >> (2 * CHUNK_SHIFT)),
+                              baseZ + ((i >> CHUNK_SHIFT) & CHUNK_MASK));
+            if (level > 0) chunk.flowLevels.push_back({ static_cast<uint16_t>(i), static_cast<uint8_t>(level) });
+        }
+    }
+
+    // Takes over the levels a chunk was loaded with. The water stays as it
+    // was saved until something next to it changes.
+    void AdoptLevels(Chunk& chunk) {
+        int baseX = chunk.coord.x * CHUNK_SIZE, baseY = chunk.coord.y * CHUNK_SIZE, baseZ = chunk.coord.z * CHUNK_SIZE;
+        for (const auto& flow : chunk.flowLevels) {
+            int i = flow.first;
+            if (flow.second > WATER_MAX_LEVEL) continue;
+            levels[Key(baseX + (i & CHUNK_MASK), baseY + (i >> (2 * CHUNK_SHIFT)),
+                       baseZ + ((i >> CHUNK_SHIFT) & CHUNK_MASK))] = flow.second;
+        }
+        std::vector<std::pair<uint16_t, uint8_t>>().swap(chunk.flowLevels);
+    }
+
+    // Drops levels and queued cells in columns that have been unloaded; their
+    // levels went to the region files with the chunks
+    void ForgetUnloaded() {
+        for (auto it = levels.begin(); it != levels.end();) {
+            if (!Loaded(KeyX(it->first), 0, KeyZ(it->first))) it = levels.erase(it);
+            else ++it;
+        }
+        active.erase(std::remove_if(active.begin(), active.end(), [this](const Cell& cell) {
+            if (Loaded(cell.x, 0, cell.z)) return false;
+            queued.erase(Key(cell.x, cell.y, cell.z));
+            return true;
+        }), active.end());
+    }
+
+    // A whole chunk was rewritten behind the simulation's back (snapshot
+    // restore). Cells that no longer hold water lose their level, levels the
+    // chunk carries are taken over, and all water in and around it is woken.
+    void ChunkRewritten(Chunk& chunk) {
+        int baseX = chunk.coord.x * CHUNK_SIZE, baseY = chunk.coord.y * CHUNK_SIZE, baseZ = chunk.coord.z * CHUNK_SIZE;
+        for (int i = 0; i < CHUNK_VOLUME; i++) {
+            if (chunk.blocks.Get(i) == BlockType::BLOCK_WATER) continue;
+            levels.erase(Key(baseX + (i & CHUNK_MASK), baseY + (i >> (2 * CHUNK_SHIFT)),
+                             baseZ + ((i >> CHUNK_SHIFT) & CHUNK_MASK)));
+        }
+        AdoptLevels(chunk);
+
+        // One block beyond the chunk too: water there may now flow into it
+        for (int y = baseY - 1; y <= baseY + CHUNK_SIZE; y++) {
+            for (int z = baseZ - 1; z <= baseZ + CHUNK_SIZE; z++) {
+                for (int x = baseX - 1; x <= baseX + CHUNK_SIZE; x++) {
+                    if (world.GetBlock(x, y, z) == BlockType::BLOCK_WATER) Wake(x, y, z);
+                }
+            }
+        }
+    }
+
+    // Any block edit: new water is a source, removed water has no level
+    void BlockChanged(int x, int y, int z) {
+        levels.erase(Key(x, y, z));
+        Wake(x, y, z);
+    }
+
+    // One simulation step; returns the number of cells updated
+    int Tick() {
+        if (active.empty()) return 0;
+        double start = GetTimeMs();
+
+        // Take the oldest cells, grouped by chunk so each task stays in one chunk
+        int count = std::min(static_cast<int>(active.size()), WATER_TICK_BUDGET);
+        batch.assign(active.begin(), active.begin() + count);
+        active.erase(active.begin(), active.begin() + count);
+        for (const Cell& cell : batch) queued.erase(Key(cell.x, cell.y, cell.z));
+        std::sort(batch.begin(), batch.end(), [](const Cell& a, const Cell& b) {
+            ChunkCoord ca = ChunkStore::ToChunkCoord(a.x, a.y, a.z);
+            ChunkCoord cb = ChunkStore::ToChunkCoord(b.x, b.y, b.z);
+            if (ca.x != cb.x) return ca.x < cb.x;
+            if (ca.z != cb.z) return ca.z < cb.z;
+            if (ca.y != cb.y) return ca.y < cb.y;
+            return Key(a.x, a.y, a.z) < Key(b.x, b.y, b.z);
+        });
+
+        std::vector<int> groupStart;
+        for (int i = 0; i < count; i++) {
+            if (i == 0 || ChunkStore::ToChunkCoord(batch[i].x, batch[i].y, batch[i].z) !=
+                          ChunkStore::ToChunkCoord(batch[i - 1].x, batch[i - 1].y, batch[i - 1].z)) {
+                groupStart.push_back(i);
+            }
+        }
+        int groups = static_cast<int>(groupStart.size());
+        groupStart.push_back(count);
+        if (static_cast<int>(groupChanges.size()) < groups) groupChanges.resize(groups);
+
+        // Parallel pass: nothing is written while cells look at their neighbours
+        jobSystem.ParallelFor(groups, 1, [&](int group, int) {
+            std::vector<Change>& out = groupChanges[group];
+            out.clear();
+            for (int i = groupStart[group]; i < groupStart[group + 1]; i++) Evaluate(batch[i], out);
+        });
+
+        // Several cells may aim at one target: the strongest water wins, and
+        // drying out only happens when nothing flows in
+        changes.clear();
+        for (int group = 0; group < groups; group++) {
+            changes.insert(changes.end(), groupChanges[group].begin(), groupChanges[group].end());
+        }
+        std::stable_sort(changes.begin(), changes.end(), [](const Change& a, const Change& b) {
+            uint64_t ka = Key(a.x, a.y, a.z), kb = Key(b.x, b.y, b.z);
+            if (ka != kb) return ka < kb;
+            return static_cast<unsigned>(a.level) < static_cast<unsigned>(b.level); // WATER_DRY sorts last
+        });
+        for (size_t i = 0; i < changes.size(); i++) {
+            if (i > 0 && Key(changes[i].x, changes[i].y, changes[i].z) ==
+                         Key(changes[i - 1].x, changes[i - 1].y, changes[i - 1].z)) {
+                continue;
+            }
+            Apply(changes[i]);
+        }
+
+        waterStats.ticks++;
+        waterStats.cellsUpdated += count;
+        waterStats.ms += GetTimeMs() - start;
+        return count;
+    }
+};
+
+WaterFlow waterFlow;
+
+void StoreWaterLevels(Chunk& chunk) {
+    waterFlow.StoreLevels(chunk);
+}
+
+void AdoptWaterLevels(Chunk& chunk) {
+    waterFlow.AdoptLevels(chunk);
+}
+
+void ForgetUnloadedWater() {
+    waterFlow.ForgetUnloaded();
+}
+
+// Player edits go through here so light and water follow the change
+void EditBlock(int x, int y, int z, BlockType type) {
+    BlockType before = world.GetBlock(x, y, z);
+    if (before == type) return;
+    world.SetBlock(x, y, z, type);
+    lightEngine.BlockChanged(world, x, y, z, before);
+    waterFlow.BlockChanged(x, y, z);
+    worldRevision++;
+}
+
+// Puts the loaded world back the way the octree snapshot saw it, undoing
+// the edits made since. Returns how many chunks changed.
+int RestoreSnapshot() {
+    std::vector<ChunkCoord> changed;
+    worldSnapshot.ToChunks(world, changed);
+    if (changed.empty()) return 0;
+    for (const ChunkCoord& coord : changed) waterFlow.ChunkRewritten(*world.GetChunk(coord));
+
+    // Light from a lamp that is gone reaches at most one column over, so the
+    // changed columns and the ring around them are relit from scratch
+    std::unordered_set<ChunkCoord, ChunkCoordHash> columns;
+    for (const ChunkCoord& coord : changed) {
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                ChunkCoord column = { coord.x + dx, 0, coord.z + dz };
+                if (loadedColumns.count(column)) columns.insert(column);
+            }
+        }
+    }
+    for (const ChunkCoord& column : columns) lightEngine.RelightColumn(world, column.x, column.z);
+    for (const ChunkCoord& column : columns) lightEngine.JoinColumn(world, column.x, column.z);
+
+    worldRevision++;
+    return static_cast<int>(changed.size());
+}
+
+// ==================== INITIALIZATION ====================
+void GenerateWorld(bool useSaves = true) {
+    // Start from an empty world (missing chunks read as air); terrain then
+    // streams in around the camera, with saved edits for this seed on top
+    chunkStreamer.Stop();
+    world.Clear();
+    loadedColumns.clear();
+    waterFlow.Clear();
+    worldRevision++;
+    terrainStats = TerrainStats();
+    lightStats = LightStats();
+    waterStats = WaterStats();
+    regionStore.Open(useSaves ? "world_" + std::to_string(worldSeed) : std::string());
+    chunkStreamer.Start(worldSeed);
+
+    // Start the camera above the ground and the trees on it
+    camera.y = std::max(camera.y, TerrainHeight(static_cast<int>(floorf(camera.x)),
+                                                static_cast<int>(floorf(camera.z)), worldSeed) + 12.0f);
+}
+
+// ==================== SOFTWARE RASTERIZER ====================
+// Faces are projected into screen triangles, binned into TILE_SIZE tiles and
+// filled tile by tile on the job system. Each tile is owned by one worker with
+// its own depth tile, so opaque triangles can arrive in any order and no two
+// threads ever write the same pixel. Colors are stored as 0x00RRGGBB, the
+// layout of a top-down 32-bit DIB.
+const int TILE_SIZE = 64;
+
+struct FrameBuffer {
+    int width, height;
+    std::vector<uint32_t> color;
+
+    FrameBuffer() : width(0), height(0) {}
+
+    void Resize(int w, int h) {
+        if (w == width && h == height) return;
+        width = w;
+        height = h;
+        color.assign(static_cast<size_t>(w) * h, 0);
+    }
+};
+
+FrameBuffer frameBuffer;
+
+inline uint32_t ToPixel(COLORREF c) {
+    return (static_cast<uint32_t>(GetRValue(c)) << 16) | (GetGValue(c) << 8) | GetBValue(c);
+}
+
+// Screen-space vertex. With perspective, 1/z (and anything divided by z) is
+// linear across the screen, so those are what get interpolated.
+struct RasterVertex {
+    float x, y;
+    float invZ;
+    float uOverZ, vOverZ; // Block grid coordinates on the face, over depth
+    float shadeOverZ;     // Ambient occlusion brightness (0-1), over depth
+};
+
+// How one triangle is filled
+struct RasterMaterial {
+    uint32_t color;
+    uint32_t edgeColor; // Block outline color when the grid is on
+    int alpha;          // 255 = opaque, writes depth
+    bool grid;
+    bool shaded;        // Corners differ in ambient occlusion: interpolate shadeOverZ
+    float pixelScale;   // Projection scale, converts 1/z into pixels per block
+};
+
+struct ScreenTriangle {
+    RasterVertex v[3];
+    RasterMaterial material;
+};
+
+struct ScreenLine {
+    float x0, y0, x1, y1;
+    uint32_t pixel;
+};
+
+// Everything submitted for one frame, in draw order
+struct FrameGeometry {
+    std::vector<ScreenTriangle> triangles;
+    std::vector<ScreenLine> lines; // Wireframe mode, drawn over the triangles
+
+    void Clear() {
+        triangles.clear();
+        lines.clear();
+    }
+};
+
+// The pixels one RasterTriangle call may touch: a tile of the color buffer
+// plus that tile's private depth values (1 / view depth, 0 = empty)
+struct RasterTarget {
+    uint32_t* color;
+    int stride;
+    float* depth;
+    int x0, y0, x1, y1; // Inclusive-exclusive pixel rectangle
+};
+
+inline uint32_t BlendPixel(uint32_t dst, uint32_t src, int alpha) {
+    uint32_t rb = ((src & 0xFF00FF) * alpha + (dst & 0xFF00FF) * (255 - alpha)) >> 8;
+    uint32_t g = ((src & 0x00FF00) * alpha + (dst & 0x00FF00) * (255 - alpha)) >> 8;
+    return (rb & 0xFF00FF) | (g & 0x00FF00);
+}
+
+inline uint32_t ScalePixel(uint32_t pixel, int scale) { // scale out of 256
+    return (((pixel & 0xFF00FF) * scale >> 8) & 0xFF00FF) | (((pixel & 0x00FF00) * scale >> 8) & 0x00FF00);
+}
+
+inline float EdgeFunction(const RasterVertex& a, const RasterVertex& b, float px, float py) {
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+// Top-left fill rule, so pixels on edges shared by two triangles are drawn once
+inline bool IsTopLeftEdge(const RasterVertex& a, const RasterVertex& b) {
+    float dx = b.x - a.x;
+    float dy = b.y - a.y;
+    return dy < 0.0f || (dy == 0.0f && dx > 0.0f);
+}
+
+void RasterTriangle(const RasterTarget& target, RasterVertex v0, RasterVertex v1, RasterVertex v2,
+                    const RasterMaterial& material) {
+    float area = EdgeFunction(v0, v1, v2.x, v2.y);
+    if (fabsf(area) < 1e-6f) return;
+    if (area < 0.0f) { // Either winding is accepted
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    int minX = std::max(target.x0, static_cast<int>(floorf(std::min(v0.x, std::min(v1.x, v2.x)))));
+    int maxX = std::min(target.x1 - 1, static_cast<int>(ceilf(std::max(v0.x, std::max(v1.x, v2.x)))));
+    int minY = std::max(target.y0, static_cast<int>(floorf(std::min(v0.y, std::min(v1.y, v2.y)))));
+    int maxY = std::min(target.y1 - 1, static_cast<int>(ceilf(std::max(v0.y, std::max(v1.y, v2.y)))));
+    if (minX > maxX || minY > maxY) return;
+
+    // Edge functions change by a constant step per pixel
+    float step0X = v1.y - v2.y, step0Y = v2.x - v1.x;
+    float step1X = v2.y - v0.y, step1Y = v0.x - v2.x;
+    float step2X = v0.y - v1.y, step2Y = v1.x - v0.x;
+    float bias0 = IsTopLeftEdge(v1, v2) ? 0.0f : -1e-5f;
+    float bias1 = IsTopLeftEdge(v2, v0) ? 0.0f : -1e-5f;
+    float bias2 = IsTopLeftEdge(v0, v1) ? 0.0f : -1e-5f;
+
+    float px = minX + 0.5f, py = minY + 0.5f;
+    float row0 = EdgeFunction(v1, v2, px, py);
+    float row1 = EdgeFunction(v2, v0, px, py);
+    float row2 = EdgeFunction(v0, v1, px, py);
+
+    int depthStride = target.x1 - target.x0;
+    float invArea = 1.0f / area;
+    for (int y = minY; y <= maxY; y++) {
+        float w0 = row0, w1 = row1, w2 = row2;
+        uint32_t* colorRow = target.color + static_cast<size_t>(y) * target.stride;
+        float* depthRow = target.depth + static_cast<size_t>(y - target.y0) * depthStride - target.x0;
+
+        for (int x = minX; x <= maxX; x++) {
+            if (w0 + bias0 >= 0.0f && w1 + bias1 >= 0.0f && w2 + bias2 >= 0.0f) {
+                float b0 = w0 * invArea, b1 = w1 * invArea, b2 = w2 * invArea;
+                float invZ = b0 * v0.invZ + b1 * v1.invZ + b2 * v2.invZ;
+
+                // Early depth rejection, before any shading work
+                if (invZ > depthRow[x]) {
+                    uint32_t pixel = material.color;
+                    float z = material.grid || material.shaded ? 1.0f / invZ : 0.0f;
+
+                    if (material.grid) {
+                        float u = (b0 * v0.uOverZ + b1 * v1.uOverZ + b2 * v2.uOverZ) * z;
+                        float v = (b0 * v0.vOverZ + b1 * v1.vOverZ + b2 * v2.vOverZ) * z;
+                        float lineWidth = z / material.pixelScale; // About one pixel
+                        float fu = u - floorf(u), fv = v - floorf(v);
+                        if (fu < lineWidth || fu > 1.0f - lineWidth || fv < lineWidth || fv > 1.0f - lineWidth) {
+                            pixel = material.edgeColor;
+                        }
+                    }
+                    if (material.shaded) {
+                        float shade = (b0 * v0.shadeOverZ + b1 * v1.shadeOverZ + b2 * v2.shadeOverZ) * z;
+                        pixel = ScalePixel(pixel, static_cast<int>(shade * 256.0f));
+                    }
+
+                    if (material.alpha >= 255) {
+                        colorRow[x] = pixel;
+                        depthRow[x] = invZ;
+                    }
+                    else {
+                        colorRow[x] = BlendPixel(colorRow[x], pixel, material.alpha);
+                    }
+                }
+            }
+            w0 += step0X;
+            w1 += step1X;
+            w2 += step2X;
+        }
+        row0 += step0Y;
+        row1 += step1Y;
+        row2 += step2Y;
+    }
+}
+
+void RasterLine(FrameBuffer& fb, float x0, float y0, float x1, float y1, uint32_t pixel) {
+    float dx = x1 - x0, dy = y1 - y0;
+    int steps = static_cast<int>(std::max(fabsf(dx), fabsf(dy)));
+    if (steps > 4 * (fb.width + fb.height)) return; // Degenerate, far off screen
+    float sx = steps > 0 ? dx / steps : 0.0f;
+    float sy = steps > 0 ? dy / steps : 0.0f;
+
+    for (int i = 0; i <= steps; i++) {
+        int x = static_cast<int>(x0 + sx * i);
+        int y = static_cast<int>(y0 + sy * i);
+        if (x >= 0 && x < fb.width && y >= 0 && y < fb.height) {
+            fb.color[static_cast<size_t>(y) * fb.width + x] = pixel;
+        }
+    }
+}
+
+// Tile bins are built per worker over a contiguous slice of the triangle list.
+// Walking worker 0's bin, then worker 1's, ... replays triangles in submission
+// order, which keeps back-to-front blending correct without any locking.
+class TileRasterizer {
+private:
+    int tilesX, tilesY;
+    std::vector<std::vector<std::vector<uint32_t>>> bins; // [worker][tile] -> triangle indices
+    std::vector<std::vector<float>> depthTiles;          // One per worker
+
+public:
+    TileRasterizer() : tilesX(0), tilesY(0) {}
+
+    void Draw(FrameBuffer& fb, const FrameGeometry& geometry, uint32_t clearPixel) {
+        tilesX = (fb.width + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (fb.height + TILE_SIZE - 1) / TILE_SIZE;
+        int tileCount = tilesX * tilesY;
+        int workers = jobSystem.WorkerCount();
+
+        bins.resize(workers);
+        for (auto& workerBins : bins) {
+            workerBins.resize(tileCount);
+            for (auto& bin : workerBins) bin.clear();
+        }
+        depthTiles.resize(workers);
+        for (auto& tile : depthTiles) tile.resize(TILE_SIZE * TILE_SIZE);
+
+        // Bin: each worker takes one slice of the triangles
+        const std::vector<ScreenTriangle>& triangles = geometry.triangles;
+        int triangleCount = static_cast<int>(triangles.size());
+        int slice = (triangleCount + workers - 1) / workers;
+        jobSystem.ParallelFor(workers, 1, [&](int part, int worker) {
+            (void)worker;
+            std::vector<std::vector<uint32_t>>& out = bins[part];
+            int end = std::min(triangleCount, (part + 1) * slice);
+            for (int i = part * slice; i < end; i++) {
+                const RasterVertex* v = triangles[i].v;
+                float minX = std::min(v[0].x, std::min(v[1].x, v[2].x));
+                float maxX = std::max(v[0].x, std::max(v[1].x, v[2].x));
+                float minY = std::min(v[0].y, std::min(v[1].y, v[2].y));
+                float maxY = std::max(v[0].y, std::max(v[1].y, v[2].y));
+                if (maxX < 0.0f || maxY < 0.0f || minX >= fb.width || minY >= fb.height) continue;
+
+                int tx0 = std::max(0, static_cast<int>(minX) / TILE_SIZE);
+                int ty0 = std::max(0, static_cast<int>(minY) / TILE_SIZE);
+                int tx1 = std::min(tilesX - 1, static_cast<int>(maxX) / TILE_SIZE);
+                int ty1 = std::min(tilesY - 1, static_cast<int>(maxY) / TILE_SIZE);
+                for (int ty = ty0; ty <= ty1; ty++) {
+                    for (int tx = tx0; tx <= tx1; tx++) {
+                        out[ty * tilesX + tx].push_back(static_cast<uint32_t>(i));
+                    }
+                }
+            }
+        });
+
+        // Shade: one tile per task, cleared and filled by a single worker
+        jobSystem.ParallelFor(tileCount, 1, [&](int tile, int worker) {
+            RasterTarget target;
+            target.color = fb.color.data();
+            target.stride = fb.width;
+            target.depth = depthTiles[worker].data();
+            target.x0 = (tile % tilesX) * TILE_SIZE;
+            target.y0 = (tile / tilesX) * TILE_SIZE;
+            target.x1 = std::min(fb.width, target.x0 + TILE_SIZE);
+            target.y1 = std::min(fb.height, target.y0 + TILE_SIZE);
+
+            std::fill(depthTiles[worker].begin(), depthTiles[worker].end(), 0.0f);
+            for (int y = target.y0; y < target.y1; y++) {
+                uint32_t* row = target.color + static_cast<size_t>(y) * target.stride;
+                std::fill(row + target.x0, row + target.x1, clearPixel);
+            }
+
+            for (int part = 0; part < workers; part++) {
+                for (uint32_t index : bins[part][tile]) {
+                    const ScreenTriangle& tri = triangles[index];
+                    RasterTriangle(target, tri.v[0], tri.v[1], tri.v[2], tri.material);
+                }
+            }
+        });
+
+        for (const ScreenLine& line : geometry.lines) {
+            RasterLine(fb, line.x0, line.y0, line.x1, line.y1, line.pixel);
+        }
+    }
+};
+
+TileRasterizer tileRasterizer;
+
+#ifdef _WIN32
+// ==================== BUFFER MANAGEMENT ====================
+void CreateBuffer(int width, int height) {
+    if (hBufferDC) {
+        DeleteDC(hBufferDC);
+        hBufferDC = NULL;
+    }
+    if (hBufferBitmap) {
+        DeleteObject(hBufferBitmap);
+        hBufferBitmap = NULL;
+    }
+
+    HDC hdc = GetDC(g_hwnd);
+    hBufferDC = CreateCompatibleDC(hdc);
+    hBufferBitmap = CreateCompatibleBitmap(hdc, width, height);
+    SelectObject(hBufferDC, hBufferBitmap);
+    ReleaseDC(g_hwnd, hdc);
+
+    bufferWidth = width;
+    bufferHeight = height;
+}
+
+// Copies the software frame buffer into the GDI back buffer
+void PresentFrameBuffer(HDC hdc) {
+    if (!hdc || frameBuffer.width == 0) return;
+
+    BITMAPINFO bmi = {};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = frameBuffer.width;
+    bmi.bmiHeader.biHeight = -frameBuffer.height; // Negative height = top-down rows
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    SetDIBitsToDevice(hdc, 0, 0, frameBuffer.width, frameBuffer.height, 0, 0, 0, frameBuffer.height,
+        frameBuffer.color.data(), &bmi, DIB_RGB_COLORS);
+}
+#endif
+
+// ==================== 3D PROJECTION ====================
+const float NEAR_PLANE = 0.1f;
+
+// Pixels per unit at depth 1, derived from camera.fov and the buffer height.
+// Updated once per frame by UpdateProjection.
+float projectionScale = 400.0f;
+
+// Camera rotation and projection constants, built once per frame so no
+// vertex ever needs sinf/cosf
+struct ViewTransform {
+    float camX, camY, camZ;
+    float cosYaw, sinYaw;
+    float cosPitch, sinPitch;
+    float scale;            // projectionScale
+    float centerX, centerY;
+    float width, height;
+};
+
+ViewTransform viewTransform;
+
+void UpdateProjection() {
+    float halfFov = camera.fov * 0.5f * 3.14159f / 180.0f;
+    projectionScale = bufferHeight * 0.5f / tanf(halfFov);
+
+    float yawRad = camera.yaw * 3.14159f / 180.0f;
+    float pitchRad = camera.pitch * 3.14159f / 180.0f;
+
+    ViewTransform& view = viewTransform;
+    view.camX = camera.x;
+    view.camY = camera.y;
+    view.camZ = camera.z;
+    view.cosYaw = cosf(yawRad);
+    view.sinYaw = sinf(yawRad);
+    view.cosPitch = cosf(pitchRad);
+    view.sinPitch = sinf(pitchRad);
+    view.scale = projectionScale;
+    view.centerX = bufferWidth * 0.5f;
+    view.centerY = bufferHeight * 0.5f;
+    view.width = static_cast<float>(bufferWidth);
+    view.height = static_cast<float>(bufferHeight);
+}
+
+// ==================== BATCH PROJECTION ====================
+// Vertices are projected in bulk from structure-of-arrays streams: 8 at a
+// time with AVX, 4 with SSE2, one by one otherwise. All paths run the same
+// operations in the same order, so results match bit for bit.
+enum ClipFlags {
+    CLIP_NEAR = 1,   // Behind the near plane; screen values are not valid
+    CLIP_LEFT = 2,
+    CLIP_RIGHT = 4,
+    CLIP_TOP = 8,
+    CLIP_BOTTOM = 16
+};
+
+struct VertexStream {
+    std::vector<float> x, y, z;
+
+    void Clear() {
+        x.clear();
+        y.clear();
+        z.clear();
+    }
+
+    void Push(const Vec3& p) {
+        x.push_back(p.x);
+        y.push_back(p.y);
+        z.push_back(p.z);
+    }
+
+    int Size() const { return static_cast<int>(x.size()); }
+};
+
+struct ProjectedVertices {
+    std::vector<float> vx, vy, vz;   // Camera space, kept for near-plane clipping
+    std::vector<float> sx, sy, invZ; // Screen position and 1 / depth
+    std::vector<uint8_t> clip;       // ClipFlags
+
+    void Resize(int count) {
+        vx.resize(count); vy.resize(count); vz.resize(count);
+        sx.resize(count); sy.resize(count); invZ.resize(count);
+        clip.resize(count);
+    }
+};
+
+inline uint8_t ClipCode(float vz, float sx, float sy, const ViewTransform& view) {
+    if (!(vz >= NEAR_PLANE)) return CLIP_NEAR;
+    return static_cast<uint8_t>((sx < 0.0f ? CLIP_LEFT : 0) | (sx > view.width ? CLIP_RIGHT : 0) |
+                                (sy < 0.0f ? CLIP_TOP : 0) | (sy > view.height ? CLIP_BOTTOM : 0));
+}
+
+void ProjectRangeScalar(const ViewTransform& view, const VertexStream& in, ProjectedVertices& out,
+                        int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        float relX = in.x[i] - view.camX;
+        float relY = in.y[i] - view.camY;
+        float relZ = in.z[i] - view.camZ;
+
+        float tx = relX * view.cosYaw - relZ * view.sinYaw;
+        float tz = relX * view.sinYaw + relZ * view.cosYaw;
+        float vy = relY * view.cosPitch - tz * view.sinPitch;
+        float vz = relY * view.sinPitch + tz * view.cosPitch;
+
+        float invZ = 1.0f / vz;
+        float sx = view.centerX + tx * view.scale * invZ;
+        float sy = view.centerY - vy * view.scale * invZ;
+
+        out.vx[i] = tx;
+        out.vy[i] = vy;
+        out.vz[i] = vz;
+        uint8_t code = ClipCode(vz, sx, sy, view);
+        bool valid = (code & CLIP_NEAR) == 0;
+        out.sx[i] = valid ? sx : 0.0f;
+        out.sy[i] = valid ? sy : 0.0f;
+        out.invZ[i] = valid ? invZ : 0.0f;
+        out.clip[i] = code;
+    }
+}
+
+#if HAS_SSE2
+int ProjectRangeSSE(const ViewTransform& view, const VertexStream& in, ProjectedVertices& out,
+                    int begin, int end) {
+    const __m128 camX = _mm_set1_ps(view.camX), camY = _mm_set1_ps(view.camY), camZ = _mm_set1_ps(view.camZ);
+    const __m128 cosYaw = _mm_set1_ps(view.cosYaw), sinYaw = _mm_set1_ps(view.sinYaw);
+    const __m128 cosPitch = _mm_set1_ps(view.cosPitch), sinPitch = _mm_set1_ps(view.sinPitch);
+    const __m128 scale = _mm_set1_ps(view.scale);
+    const __m128 centerX = _mm_set1_ps(view.centerX), centerY = _mm_set1_ps(view.centerY);
+    const __m128 one = _mm_set1_ps(1.0f), nearPlane = _mm_set1_ps(NEAR_PLANE);
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 relX = _mm_sub_ps(_mm_loadu_ps(&in.x[i]), camX);
+        __m128 relY = _mm_sub_ps(_mm_loadu_ps(&in.y[i]), camY);
+        __m128 relZ = _mm_sub_ps(_mm_loadu_ps(&in.z[i]), camZ);
+
+        __m128 tx = _mm_sub_ps(_mm_mul_ps(relX, cosYaw), _mm_mul_ps(relZ, sinYaw));
+        __m128 tz = _mm_add_ps(_mm_mul_ps(relX, sinYaw), _mm_mul_ps(relZ, cosYaw));
+        __m128 vy = _mm_sub_ps(_mm_mul_ps(relY, cosPitch), _mm_mul_ps(tz, sinPitch));
+        __m128 vz = _mm_add_ps(_mm_mul_ps(relY, sinPitch), _mm_mul_ps(tz, cosPitch));
+
+        __m128 invZ = _mm_div_ps(one, vz);
+        __m128 sx = _mm_add_ps(centerX, _mm_mul_ps(_mm_mul_ps(tx, scale), invZ));
+        __m128 sy = _mm_sub_ps(centerY, _mm_mul_ps(_mm_mul_ps(vy, scale), invZ));
+
+        // Zero the screen values of lanes behind the near plane
+        __m128 valid = _mm_cmpge_ps(vz, nearPlane);
+        _mm_storeu_ps(&out.vx[i], tx);
+        _mm_storeu_ps(&out.vy[i], vy);
+        _mm_storeu_ps(&out.vz[i], vz);
+        _mm_storeu_ps(&out.sx[i], _mm_and_ps(valid, sx));
+        _mm_storeu_ps(&out.sy[i], _mm_and_ps(valid, sy));
+        _mm_storeu_ps(&out.invZ[i], _mm_and_ps(valid, invZ));
+
+        for (int lane = 0; lane < 4; lane++) {
+            out.clip[i + lane] = ClipCode(out.vz[i + lane], out.sx[i + lane], out.sy[i + lane], view);
+        }
+    }
+    return i;
+}
+#endif
+
+#if HAS_AVX
+int ProjectRangeAVX(const ViewTransform& view, const VertexStream& in, ProjectedVertices& out,
+                    int begin, int end) {
+    const __m256 camX = _mm256_set1_ps(view.camX), camY = _mm256_set1_ps(view.camY), camZ = _mm256_set1_ps(view.camZ);
+    const __m256 cosYaw = _mm256_set1_ps(view.cosYaw), sinYaw = _mm256_set1_ps(view.sinYaw);
+    const __m256 cosPitch = _mm256_set1_ps(view.cosPitch), sinPitch = _mm256_set1_ps(view.sinPitch);
+    const __m256 scale = _mm256_set1_ps(view.scale);
+    const __m256 centerX = _mm256_set1_ps(view.centerX), centerY = _mm256_set1_ps(view.centerY);
+    const __m256 one = _mm256_set1_ps(1.0f), nearPlane = _mm256_set1_ps(NEAR_PLANE);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 relX = _mm256_sub_ps(_mm256_loadu_ps(&in.x[i]), camX);
+        __m256 relY = _mm256_sub_ps(_mm256_loadu_ps(&in.y[i]), camY);
+        __m256 relZ = _mm256_sub_ps(_mm256_loadu_ps(&in.z[i]), camZ);
+
+        __m256 tx = _mm256_sub_ps(_mm256_mul_ps(relX, cosYaw), _mm256_mul_ps(relZ, sinYaw));
+        __m256 tz = _mm256_add_ps(_mm256_mul_ps(relX, sinYaw), _mm256_mul_ps(relZ, cosYaw));
+        __m256 vy = _mm256_sub_ps(_mm256_mul_ps(relY, cosPitch), _mm256_mul_ps(tz, sinPitch));
+        __m256 vz = _mm256_add_ps(_mm256_mul_ps(relY, sinPitch), _mm256_mul_ps(tz, cosPitch));
+
+        __m256 invZ = _mm256_div_ps(one, vz);
+        __m256 sx = _mm256_add_ps(centerX, _mm256_mul_ps(_mm256_mul_ps(tx, scale), invZ));
+        __m256 sy = _mm256_sub_ps(centerY, _mm256_mul_ps(_mm256_mul_ps(vy, scale), invZ));
+
+        __m256 valid = _mm256_cmp_ps(vz, nearPlane, _CMP_GE_OQ);
+        _mm256_storeu_ps(&out.vx[i], tx);
+        _mm256_storeu_ps(&out.vy[i], vy);
+        _mm256_storeu_ps(&out.vz[i], vz);
+        _mm256_storeu_ps(&out.sx[i], _mm256_and_ps(valid, sx));
+        _mm256_storeu_ps(&out.sy[i], _mm256_and_ps(valid, sy));
+        _mm256_storeu_ps(&out.invZ[i], _mm256_and_ps(valid, invZ));
+
+        for (int lane = 0; lane < 8; lane++) {
+            out.clip[i + lane] = ClipCode(out.vz[i + lane], out.sx[i + lane], out.sy[i + lane], view);
+        }
+    }
+    return i;
+}
+#endif
+
+void ProjectRange(const ViewTransform& view, const VertexStream& in, ProjectedVertices& out, int begin, int end) {
+    int i = begin;
+#if HAS_AVX
+    i = ProjectRangeAVX(view, in, out, i, end);
+#endif
+#if HAS_SSE2
+    i = ProjectRangeSSE(view, in, out, i, end);
+#endif
+    ProjectRangeScalar(view, in, out, i, end);
+}
+
+// Projects a whole stream, split into blocks across the job system
+void ProjectVertices(const ViewTransform& view, const VertexStream& in, ProjectedVertices& out) {
+    const int BLOCK = 4096;
+    int count = in.Size();
+    out.Resize(count);
+
+    int blocks = (count + BLOCK - 1) / BLOCK;
+    jobSystem.ParallelFor(blocks, 1, [&](int block, int worker) {
+        (void)worker;
+        ProjectRange(view, in, out, block * BLOCK, std::min(count, (block + 1) * BLOCK));
+    });
+}
+
+// Camera-space point plus the grid coordinates it carries through clipping
+struct ViewVertex {
+    Vec3 p;
+    float u, v;
+    float shade;
+};
+
+// Perspective projection of a point in front of the near plane
+RasterVertex ProjectView(const ViewTransform& view, const ViewVertex& in) {
+    float invZ = 1.0f / in.p.z;
+
+    RasterVertex out;
+    out.x = view.centerX + in.p.x * view.scale * invZ;
+    out.y = view.centerY - in.p.y * view.scale * invZ;
+    out.invZ = invZ;
+    out.uOverZ = in.u * invZ;
+    out.vOverZ = in.v * invZ;
+    out.shadeOverZ = in.shade * invZ;
+    return out;
+}
+
+// Sutherland-Hodgman against z = NEAR_PLANE; returns the output vertex count
+int ClipNear(const ViewVertex* in, int count, ViewVertex* out) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        const ViewVertex& a = in[i];
+        const ViewVertex& b = in[(i + 1) % count];
+        bool aIn = a.p.z >= NEAR_PLANE;
+        bool bIn = b.p.z >= NEAR_PLANE;
+
+        if (aIn) out[n++] = a;
+        if (aIn != bIn) {
+            float t = (NEAR_PLANE - a.p.z) / (b.p.z - a.p.z);
+            ViewVertex mid;
+            mid.p = a.p + (b.p - a.p) * t;
+            mid.u = a.u + (b.u - a.u) * t;
+            mid.v = a.v + (b.v - a.v) * t;
+            mid.shade = a.shade + (b.shade - a.shade) * t;
+            out[n++] = mid;
+        }
+    }
+    return n;
+}
+
+// ==================== FRUSTUM CULLING ====================
+// Planes of the view volume in world space, normals pointing inwards. Built
+// once per frame so chunks and faces can be rejected before projection.
+struct Plane {
+    Vec3 n;
+    float d;
+
+    float Distance(const Vec3& p) const { return n.x * p.x + n.y * p.y + n.z * p.z + d; }
+};
+
+// Inverse of the view rotation (pitch, then yaw), for directions
+Vec3 ViewToWorldDir(const Vec3& v) {
+    float pitchRad = camera.pitch * 3.14159f / 180.0f;
+    float cp = cosf(pitchRad), sp = sinf(pitchRad);
+    float y = v.y * cp + v.z * sp;
+    float z = -v.y * sp + v.z * cp;
+
+    float yawRad = camera.yaw * 3.14159f / 180.0f;
+    float cy = cosf(yawRad), sy = sinf(yawRad);
+    return Vec3(v.x * cy + z * sy, y, -v.x * sy + z * cy);
+}
+
+struct ViewFrustum {
+    enum { PLANE_COUNT = 5 };
+    Plane planes[PLANE_COUNT]; // Near, left, right, bottom, top
+
+    // Axis-aligned box test: rejected only if fully outside one plane
+    bool IntersectsBox(const Vec3& lo, const Vec3& hi) const {
+        for (int i = 0; i < PLANE_COUNT; i++) {
+            const Plane& plane = planes[i];
+            // Corner furthest along the normal
+            Vec3 p(plane.n.x >= 0.0f ? hi.x : lo.x,
+                   plane.n.y >= 0.0f ? hi.y : lo.y,
+                   plane.n.z >= 0.0f ? hi.z : lo.z);
+            if (plane.Distance(p) < 0.0f) return false;
+        }
+        return true;
+    }
+
+    bool IntersectsQuad(const Vec3* corners) const {
+        for (int i = 0; i < PLANE_COUNT; i++) {
+            const Plane& plane = planes[i];
+            if (plane.Distance(corners[0]) < 0.0f && plane.Distance(corners[1]) < 0.0f &&
+                plane.Distance(corners[2]) < 0.0f && plane.Distance(corners[3]) < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Builds the frustum from camera position, yaw, pitch and fov, matching ProjectView
+ViewFrustum BuildFrustum() {
+    float tanY = bufferHeight * 0.5f / projectionScale;
+    float tanX = bufferWidth * 0.5f / projectionScale;
+
+    // Inward normals in view space (+Z forward); side planes pass through the eye
+    Vec3 viewNormals[ViewFrustum::PLANE_COUNT] = {
+        Vec3(0.0f, 0.0f, 1.0f),
+        Vec3(1.0f, 0.0f, tanX),
+        Vec3(-1.0f, 0.0f, tanX),
+        Vec3(0.0f, 1.0f, tanY),
+        Vec3(0.0f, -1.0f, tanY)
+    };
+
+    ViewFrustum frustum;
+    Vec3 eye(camera.x, camera.y, camera.z);
+    for (int i = 0; i < ViewFrustum::PLANE_COUNT; i++) {
+        Vec3 n = ViewToWorldDir(viewNormals[i]);
+        frustum.planes[i].n = n;
+        frustum.planes[i].d = -(n.x * eye.x + n.y * eye.y + n.z * eye.z);
+    }
+    frustum.planes[0].d -= NEAR_PLANE;
+    return frustum;
+}
+
+// ==================== BACKFACE CULLING ====================
+// Block faces are axis aligned, so a face points at the camera exactly when the
+// camera is on the outer side of its plane: a single comparison, no projection.
+inline float AxisValue(const Vec3& v, int axis) {
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+inline bool IsPositiveDir(FaceDir dir) {
+    const FaceDirInfo& info = FaceDirs[dir];
+    return info.dx + info.dy + info.dz > 0;
+}
+
+bool FacesCamera(const Face& face) {
+    int axis = FaceDirs[face.dir].axis;
+    float offset = AxisValue(Vec3(camera.x, camera.y, camera.z), axis) - AxisValue(face.corners[0], axis);
+    return IsPositiveDir(face.dir) ? offset > 0.0f : offset < 0.0f;
+}
+
+// True when every face of direction 'dir' inside the box [lo, hi] faces away:
+// the camera is behind the box along that direction
+bool IsBackFacingGroup(FaceDir dir, const Vec3& lo, const Vec3& hi) {
+    int axis = FaceDirs[dir].axis;
+    float cam = AxisValue(Vec3(camera.x, camera.y, camera.z), axis);
+    return IsPositiveDir(dir) ? cam <= AxisValue(lo, axis) : cam >= AxisValue(hi, axis);
+}
+
+// ==================== DEPTH SORTING ====================
+// Blended faces are ordered through 8-byte (key, index) pairs instead of the
+// faces themselves. Keys are sorted with a stable LSD radix sort, 11 bits per
+// pass: every worker counts the digits of its own slice, the counts become
+// per-worker output offsets, and each worker scatters its slice in order.
+const int RADIX_BITS = 11;
+const int RADIX_BUCKETS = 1 << RADIX_BITS;
+const int RADIX_PASSES = (32 + RADIX_BITS - 1) / RADIX_BITS;
+const int RADIX_SLICE_MIN = 16384;      // Keys per worker before splitting pays off
+const int RADIX_MIN_KEYS = 64;          // Fewer keys than this use insertion sort
+
+struct DepthKey {
+    uint32_t key;   // Sorts ascending
+    uint32_t index; // Position in the caller's item list
+};
+
+// Far faces first. Non-negative floats order like their bit patterns, so
+// flipping the bits gives descending distance as ascending integers.
+inline uint32_t FarFirstKey(float distanceSq) {
+    uint32_t bits;
+    memcpy(&bits, &distanceSq, sizeof(bits));
+    return ~bits;
+}
+
+class DepthSorter {
+private:
+    std::vector<DepthKey> scratch;
+    std::vector<uint32_t> counts; // [slice][digit] histograms, then offsets
+
+public:
+    void Sort(std::vector<DepthKey>& keys) {
+        int count = static_cast<int>(keys.size());
+        if (count < RADIX_MIN_KEYS) {
+            // Too few keys to pay for clearing the buckets (still stable)
+            for (int i = 1; i < count; i++) {
+                DepthKey item = keys[i];
+                int j = i;
+                for (; j > 0 && keys[j - 1].key > item.key; j--) keys[j] = keys[j - 1];
+                keys[j] = item;
+            }
+            return;
+        }
+        scratch.resize(keys.size());
+
+        int slices = std::max(1, std::min(jobSystem.WorkerCount(), count / RADIX_SLICE_MIN));
+        int sliceSize = (count + slices - 1) / slices;
+        counts.assign(static_cast<size_t>(slices) * RADIX_BUCKETS, 0);
+
+        DepthKey* src = keys.data();
+        DepthKey* dst = scratch.data();
+        for (int pass = 0; pass < RADIX_PASSES; pass++) {
+            int shift = pass * RADIX_BITS;
+
+            jobSystem.ParallelFor(slices, 1, [&](int slice, int) {
+                uint32_t* histogram = &counts[static_cast<size_t>(slice) * RADIX_BUCKETS];
+                std::fill(histogram, histogram + RADIX_BUCKETS, 0u);
+                int end = std::min(count, (slice + 1) * sliceSize);
+                for (int i = slice * sliceSize; i < end; i++) {
+                    histogram[(src[i].key >> shift) & (RADIX_BUCKETS - 1)]++;
+                }
+            });
+
+            // Every key has the same digit: this pass would not move anything
+            bool trivial = false;
+            for (int digit = 0; digit < RADIX_BUCKETS && !trivial; digit++) {
+                uint32_t total = 0;
+                for (int slice = 0; slice < slices; slice++) total += counts[slice * RADIX_BUCKETS + digit];
+                trivial = total == static_cast<uint32_t>(count);
+            }
+            if (trivial) continue;
+
+            // Digit-major, slice-minor prefix sum keeps equal digits in input order
+            uint32_t offset = 0;
+            for (int digit = 0; digit < RADIX_BUCKETS; digit++) {
+                for (int slice = 0; slice < slices; slice++) {
+                    uint32_t& entry = counts[slice * RADIX_BUCKETS + digit];
+                    uint32_t n = entry;
+                    entry = offset;
+                    offset += n;
+                }
+            }
+
+            jobSystem.ParallelFor(slices, 1, [&](int slice, int) {
+                uint32_t* next = &counts[static_cast<size_t>(slice) * RADIX_BUCKETS];
+                int end = std::min(count, (slice + 1) * sliceSize);
+                for (int i = slice * sliceSize; i < end; i++) {
+                    dst[next[(src[i].key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+                }
+            });
+            std::swap(src, dst);
+        }
+
+        if (src != keys.data()) keys.swap(scratch);
+    }
+};
+
+DepthSorter depthSorter;
+
+// ==================== RENDER FUNCTIONS ====================
+
+// Brightness (out of 255) for each light level; every level down is 20% darker
+const int LightCurve[LIGHT_MAX + 1] = {
+    9, 11, 14, 18, 22, 27, 34, 43, 53, 67, 84, 104, 131, 163, 204, 255
+};
+
+COLORREF ShadeFace(const Face& face) {
+    // Calculate lighting
+    int base = face.isTop ? 220 : 180;
+    int daylight = base;
+    if (dayNightCycle) {
+        float timeFactor = sinf(timeOfDay * 3.14159f / 12.0f);
+        daylight += static_cast<int>(50.0f * timeFactor);
+    }
+
+    // Sky light follows the time of day, lamps don't
+    int brightness = std::max(daylight * LightCurve[LightLevel(face.light, LIGHT_SKY)],
+                              base * LightCurve[LightLevel(face.light, LIGHT_BLOCK)]) / 255;
+
+    // Clamp brightness
+    if (brightness < 50) brightness = 50;
+    if (brightness > 255) brightness = 255;
+
+    int r = GetRValue(face.color) * brightness / 255;
+    int g = GetGValue(face.color) * brightness / 255;
+    int b = GetBValue(face.color) * brightness / 255;
+
+    return RGB(r, g, b);
+}
+
+// Distance fog toward the sky colour. The table maps squared distance from
+// the camera to a fog amount, so faces need no square root or division; it is
+// rebuilt each frame because the sky colour and render distance change.
+const int FOG_TABLE_SIZE = 1024;
+const float FOG_START = 0.6f; // Fraction of the fog distance where fog begins
+
+struct FogTable {
+    bool enabled;
+    float endSq;    // Fully fogged from this squared distance on; culled beyond it
+    float scale;    // Squared distance -> table index
+    uint32_t pixel; // Fog colour
+    uint8_t amount[FOG_TABLE_SIZE]; // 0 = clear, 255 = fully fogged
+
+    void Build(float end, COLORREF color) {
+        enabled = true;
+        endSq = end * end;
+        scale = (FOG_TABLE_SIZE - 1) / endSq;
+        pixel = ToPixel(color);
+        for (int i = 0; i < FOG_TABLE_SIZE; i++) {
+            float distance = sqrtf(i / scale);
+            float t = (distance - end * FOG_START) / (end * (1.0f - FOG_START));
+            amount[i] = static_cast<uint8_t>(std::max(0.0f, std::min(1.0f, t)) * 255.0f + 0.5f);
+        }
+    }
+
+    int Amount(float distanceSq) const {
+        return distanceSq >= endSq ? 255 : amount[static_cast<int>(distanceSq * scale)];
+    }
+};
+
+FogTable fog = {};
+
+// Squared distance from p to the nearest point of the box [lo, hi]
+inline float BoxDistanceSq(const Vec3& lo, const Vec3& hi, const Vec3& p) {
+    float dx = std::max(0.0f, std::max(lo.x - p.x, p.x - hi.x));
+    float dy = std::max(0.0f, std::max(lo.y - p.y, p.y - hi.y));
+    float dz = std::max(0.0f, std::max(lo.z - p.z, p.z - hi.z));
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Brightness of a corner at each ambient occlusion level
+const float AOBrightness[AO_OPEN + 1] = { 0.55f, 0.7f, 0.85f, 1.0f };
+
+// Queues one face's triangles (or outline) for the tile rasterizer. Its four
+// corners were already batch projected; ids are their slots in proj.
+void SubmitFace(FrameGeometry& geometry, const Face& face, const ProjectedVertices& proj, const int ids[4]) {
+    // u/v are the face's in-plane world coordinates
+    int axis = FaceDirs[face.dir].axis;
+    int uAxis = (axis + 1) % 3;
+    int vAxis = (axis + 2) % 3;
+
+    // Every corner off the same screen edge: nothing to draw
+    uint8_t allClip = 0xFF, anyClip = 0;
+    for (int i = 0; i < 4; i++) {
+        allClip &= proj.clip[ids[i]];
+        anyClip |= proj.clip[ids[i]];
+    }
+    if (allClip != 0) return;
+
+    RasterVertex points[8];
+    int count = 0;
+    if ((anyClip & CLIP_NEAR) == 0) {
+        // Common case: use the batch results as they are
+        for (int i = 0; i < 4; i++) {
+            const Vec3& c = face.corners[i];
+            float invZ = proj.invZ[ids[i]];
+            RasterVertex& out = points[count++];
+            out.x = proj.sx[ids[i]];
+            out.y = proj.sy[ids[i]];
+            out.invZ = invZ;
+            out.uOverZ = AxisValue(c, uAxis) * invZ;
+            out.vOverZ = AxisValue(c, vAxis) * invZ;
+            out.shadeOverZ = AOBrightness[face.ao[i]] * invZ;
+        }
+    }
+    else {
+        // Faces crossing the near plane are clipped instead of dropped
+        ViewVertex corners[4];
+        for (int i = 0; i < 4; i++) {
+            const Vec3& c = face.corners[i];
+            corners[i].p = Vec3(proj.vx[ids[i]], proj.vy[ids[i]], proj.vz[ids[i]]);
+            corners[i].u = AxisValue(c, uAxis);
+            corners[i].v = AxisValue(c, vAxis);
+            corners[i].shade = AOBrightness[face.ao[i]];
+        }
+
+        ViewVertex clipped[8];
+        int clippedCount = ClipNear(corners, 4, clipped);
+        if (clippedCount < 3) return;
+
+        for (int i = 0; i < clippedCount; i++) {
+            points[count++] = ProjectView(viewTransform, clipped[i]);
+        }
+    }
 
-    Vec3 rotateY(float angle) const {
-        float rad = angle * 3.14159f / 180.0f;
-        float c = cosf(rad);
-        float s = sinf(rad);
-        return Vec3(x * c - z * s, y, x * s + z * c);
+    if (wireframeMode) {
+        uint32_t pixel = ToPixel(RGB(100, 100, 100));
+        for (int i = 0; i < count; i++) {
+            const RasterVertex& a = points[i];
+            const RasterVertex& b = points[(i + 1) % count];
+            ScreenLine line = { a.x, a.y, b.x, b.y, pixel };
+            geometry.lines.push_back(line);
+        }
+        return;
     }
 
-    Vec3 rotateX(float angle) const {
-        float rad = angle * 3.14159f / 180.0f;
-        float c = cosf(rad);
-        float s = sinf(rad);
-        return Vec3(x, y * c - z * s, y * s + z * c);
+    COLORREF shaded = ShadeFace(face);
+
+    RasterMaterial material;
+    material.color = ToPixel(shaded);
+    material.edgeColor = ToPixel(RGB(GetRValue(shaded) / 2, GetGValue(shaded) / 2, GetBValue(shaded) / 2));
+    if (fog.enabled) {
+        // One fog amount per face, taken at its center
+        Vec3 center = (face.corners[0] + face.corners[2]) * 0.5f;
+        float dx = center.x - viewTransform.camX, dy = center.y - viewTransform.camY, dz = center.z - viewTransform.camZ;
+        int amount = fog.Amount(dx * dx + dy * dy + dz * dz);
+        material.color = BlendPixel(material.color, fog.pixel, amount);
+        material.edgeColor = BlendPixel(material.edgeColor, fog.pixel, amount);
     }
+    material.alpha = BlockAlpha[static_cast<int>(face.type)];
+    material.grid = showGrid;
+    material.shaded = face.HasOcclusion();
+    material.pixelScale = projectionScale;
+
+    // Convex polygon, drawn as a triangle fan. An unclipped quad is split
+    // along the diagonal with the brighter corners, so a single dark corner
+    // fades out evenly instead of streaking along the other diagonal.
+    int first = 0;
+    if (count == 4 && face.ao[0] + face.ao[2] < face.ao[1] + face.ao[3]) first = 1;
+    for (int i = 1; i + 1 < count; i++) {
+        ScreenTriangle tri;
+        tri.v[0] = points[first];
+        tri.v[1] = points[(first + i) % count];
+        tri.v[2] = points[(first + i + 1) % count];
+        tri.material = material;
+        geometry.triangles.push_back(tri);
+    }
+}
 
-    Vec3 operator+(const Vec3& v) const { return Vec3(x + v.x, y + v.y, z + v.z); }
-    Vec3 operator-(const Vec3& v) const { return Vec3(x - v.x, y - v.y, z - v.z); }
-    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
-};
+// ==================== CHUNK MESHING ====================
+// A chunk plus a one-block border copied from its 26 neighbours, so face
+// visibility tests are plain array reads instead of hash lookups
+const int PADDED_SIZE = CHUNK_SIZE + 2;
 
-// ==================== FACE STRUCTURE ====================
-struct Face {
-    Vec3 corners[4];
-    COLORREF color;
-    float depth;
-    bool isTop;
+struct MeshVolume {
+    BlockType blocks[PADDED_SIZE * PADDED_SIZE * PADDED_SIZE];
+    uint8_t light[PADDED_SIZE * PADDED_SIZE * PADDED_SIZE]; // Packed, as in Chunk::light
 
-    // Initialize members to fix warnings
-    Face() : color(0), depth(0.0f), isTop(false) {
-        corners[0] = Vec3();
-        corners[1] = Vec3();
-        corners[2] = Vec3();
-        corners[3] = Vec3();
+    static int Index(int lx, int ly, int lz) {
+        return ((ly + 1) * PADDED_SIZE + (lz + 1)) * PADDED_SIZE + (lx + 1);
     }
 
-    bool operator<(const Face& other) const {
-        return depth > other.depth; // Sort back to front
+    // Local chunk coordinates, valid from -1 to CHUNK_SIZE
+    BlockType Get(int lx, int ly, int lz) const {
+        return blocks[Index(lx, ly, lz)];
     }
-};
-
-// ==================== INITIALIZATION ====================
-void GenerateWorld() {
-    srand(static_cast<unsigned int>(time(NULL)));
 
-    // Initialize all to air first
-    for (int x = 0; x < WORLD_WIDTH; x++) {
-        for (int y = 0; y < WORLD_HEIGHT; y++) {
-            for (int z = 0; z < WORLD_DEPTH; z++) {
-                world[x][y][z] = BlockType::BLOCK_AIR;
-            }
-        }
+    void Set(int lx, int ly, int lz, BlockType type) {
+        blocks[Index(lx, ly, lz)] = type;
     }
 
-    // Generate simple flat terrain
-    for (int x = 0; x < WORLD_WIDTH; x++) {
-        for (int z = 0; z < WORLD_DEPTH; z++) {
-            // Flat ground at y = 3
-            int groundHeight = 3;
-
-            // Bedrock at bottom
-            world[x][0][z] = BlockType::BLOCK_STONE;
+    uint8_t LightAt(int lx, int ly, int lz) const {
+        return light[Index(lx, ly, lz)];
+    }
+};
 
-            // Dirt layer
-            for (int y = 1; y < groundHeight; y++) {
-                world[x][y][z] = BlockType::BLOCK_DIRT;
+void FillMeshVolume(MeshVolume& volume, const ChunkStore& store, const ChunkCoord& coord) {
+    // Look up the 3x3x3 block of chunks once
+    const Chunk* around[27];
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                around[((dy + 1) * 3 + (dz + 1)) * 3 + (dx + 1)] =
+                    store.GetChunk({ coord.x + dx, coord.y + dy, coord.z + dz });
             }
+        }
+    }
 
-            // Grass on top
-            world[x][groundHeight][z] = BlockType::BLOCK_GRASS;
-
-            // Add some trees
-            if (rand() % 10 == 0 && x > 1 && x < WORLD_WIDTH - 2 && z > 1 && z < WORLD_DEPTH - 2) {
-                // Tree trunk
-                for (int y = groundHeight + 1; y <= groundHeight + 4 && y < WORLD_HEIGHT; y++) {
-                    world[x][y][z] = BlockType::BLOCK_WOOD;
+    BlockType* out = volume.blocks;
+    uint8_t* outLight = volume.light;
+    for (int ly = -1; ly <= CHUNK_SIZE; ly++) {
+        int cy = ly < 0 ? 0 : (ly < CHUNK_SIZE ? 1 : 2);
+        for (int lz = -1; lz <= CHUNK_SIZE; lz++) {
+            int cz = lz < 0 ? 0 : (lz < CHUNK_SIZE ? 1 : 2);
+            for (int lx = -1; lx <= CHUNK_SIZE; lx++) {
+                int cx = lx < 0 ? 0 : (lx < CHUNK_SIZE ? 1 : 2);
+                const Chunk* chunk = around[(cy * 3 + cz) * 3 + cx];
+                if (chunk) {
+                    int index = Chunk::Index(lx & CHUNK_MASK, ly & CHUNK_MASK, lz & CHUNK_MASK);
+                    *out++ = chunk->blocks.Get(index);
+                    *outLight++ = chunk->LightAt(index);
                 }
-
-                // Tree leaves (simple cube)
-                for (int dx = -1; dx <= 1; dx++) {
-                    for (int dz = -1; dz <= 1; dz++) {
-                        for (int dy = 0; dy <= 2; dy++) {
-                            int lx = x + dx;
-                            int lz = z + dz;
-                            int ly = groundHeight + 4 + dy;
-
-                            if (lx >= 0 && lx < WORLD_WIDTH &&
-                                lz >= 0 && lz < WORLD_DEPTH &&
-                                ly >= 0 && ly < WORLD_HEIGHT) {
-                                // Don't replace trunk
-                                if (!(dx == 0 && dz == 0 && dy == 0)) {
-                                    world[lx][ly][lz] = BlockType::BLOCK_LEAVES;
-                                }
-                            }
-                        }
-                    }
+                else {
+                    *out++ = BlockType::BLOCK_AIR;
+                    *outLight++ = FULL_SKY_LIGHT;
                 }
             }
         }
     }
+}
+
+// One cell of a chunk downsampled to the given level, by majority: the cell
+// is solid when at least half of its blocks are, and then takes the most
+// common solid type among them
+BlockType DownsampleCell(const Chunk& chunk, int level, int cx, int cy, int cz) {
+    int scale = 1 << level;
+    int counts[static_cast<int>(BlockType::BLOCK_COUNT)] = {};
+    for (int ly = cy * scale; ly < (cy + 1) * scale; ly++) {
+        for (int lz = cz * scale; lz < (cz + 1) * scale; lz++) {
+            for (int lx = cx * scale; lx < (cx + 1) * scale; lx++) {
+                counts[static_cast<int>(chunk.Get(lx, ly, lz))]++;
+            }
+        }
+    }
 
-    // Add a simple house
-    int houseX = WORLD_WIDTH / 2;
-    int houseZ = WORLD_DEPTH / 2;
-    int groundY = 3;
+    int air = static_cast<int>(BlockType::BLOCK_AIR);
+    if ((scale * scale * scale - counts[air]) * 2 < scale * scale * scale) return BlockType::BLOCK_AIR;
 
-    // House foundation (3x3)
-    for (int dx = -1; dx <= 1; dx++) {
-        for (int dz = -1; dz <= 1; dz++) {
-            if (houseX + dx >= 0 && houseX + dx < WORLD_WIDTH &&
-                houseZ + dz >= 0 && houseZ + dz < WORLD_DEPTH) {
-                world[houseX + dx][groundY][houseZ + dz] = BlockType::BLOCK_BRICK;
+    int best = -1;
+    for (int type = 0; type < static_cast<int>(BlockType::BLOCK_COUNT); type++) {
+        if (type != air && (best < 0 || counts[type] > counts[best])) best = type;
+    }
+    return static_cast<BlockType>(best);
+}
+
+// Like FillMeshVolume, but with the chunk downsampled to (CHUNK_SIZE >> level)
+// cells per axis. The border holds the touching cells of the six face
+// neighbours at the same level; edges and corners are left as air, which
+// only lightens ambient occlusion along chunk edges. Distant faces are lit
+// as if under open sky.
+void FillLodVolume(MeshVolume& volume, const ChunkStore& store, const Chunk& chunk, int level) {
+    int size = CHUNK_SIZE >> level;
+    std::fill(volume.blocks, volume.blocks + PADDED_SIZE * PADDED_SIZE * PADDED_SIZE, BlockType::BLOCK_AIR);
+    std::fill(volume.light, volume.light + PADDED_SIZE * PADDED_SIZE * PADDED_SIZE, FULL_SKY_LIGHT);
+
+    for (int cy = 0; cy < size; cy++) {
+        for (int cz = 0; cz < size; cz++) {
+            for (int cx = 0; cx < size; cx++) {
+                volume.Set(cx, cy, cz, DownsampleCell(chunk, level, cx, cy, cz));
             }
         }
     }
 
-    // House walls
-    for (int y = groundY + 1; y <= groundY + 2; y++) {
-        for (int dx = -1; dx <= 1; dx++) {
-            for (int dz = -1; dz <= 1; dz++) {
-                if (abs(dx) == 1 || abs(dz) == 1) { // Only walls (perimeter)
-                    if (houseX + dx >= 0 && houseX + dx < WORLD_WIDTH &&
-                        houseZ + dz >= 0 && houseZ + dz < WORLD_DEPTH) {
-                        // Windows on middle row
-                        if (y == groundY + 2 && (dx == 0 || dz == 0)) {
-                            world[houseX + dx][y][houseZ + dz] = BlockType::BLOCK_GLASS;
-                        }
-                        else {
-                            world[houseX + dx][y][houseZ + dz] = BlockType::BLOCK_BRICK;
-                        }
-                    }
-                }
+    for (int d = 0; d < FACE_COUNT; d++) {
+        const FaceDirInfo& info = FaceDirs[d];
+        const Chunk* neighbour = store.GetChunk(
+            { chunk.coord.x + info.dx, chunk.coord.y + info.dy, chunk.coord.z + info.dz });
+        if (!neighbour || neighbour->solidCount == 0) continue;
+
+        // Walk the layer of the neighbour that touches this chunk
+        int axis = info.axis;
+        int step = info.dx + info.dy + info.dz;
+        int cell[3];
+        for (int v = 0; v < size; v++) {
+            for (int u = 0; u < size; u++) {
+                cell[(axis + 1) % 3] = u;
+                cell[(axis + 2) % 3] = v;
+                cell[axis] = step > 0 ? 0 : size - 1;
+                BlockType type = DownsampleCell(*neighbour, level, cell[0], cell[1], cell[2]);
+                cell[axis] = step > 0 ? size : -1;
+                volume.Set(cell[0], cell[1], cell[2], type);
             }
         }
     }
+}
 
-    // Roof
-    if (groundY + 3 < WORLD_HEIGHT) {
-        world[houseX][groundY + 3][houseZ] = BlockType::BLOCK_WOOD;
+// Ambient occlusion at the four corners of the face on side d of a block,
+// from the three blocks in front of the face around each corner. Indexed by
+// corner quadrant: bit 0 for the high side along u, bit 1 along v.
+void FaceCornerAO(const MeshVolume& volume, int d, int lx, int ly, int lz, uint8_t ao[4]) {
+    const FaceDirInfo& info = FaceDirs[d];
+    int uAxis = (info.axis + 1) % 3;
+    int vAxis = (info.axis + 2) % 3;
+    const int front[3] = { lx + info.dx, ly + info.dy, lz + info.dz };
+
+    for (int q = 0; q < 4; q++) {
+        int side1[3] = { front[0], front[1], front[2] };
+        int side2[3] = { front[0], front[1], front[2] };
+        side1[uAxis] += q & 1 ? 1 : -1;
+        side2[vAxis] += q & 2 ? 1 : -1;
+        int corner[3] = { side1[0], side1[1], side1[2] };
+        corner[vAxis] = side2[vAxis];
+
+        int s1 = !IsTransparent(volume.Get(side1[0], side1[1], side1[2]));
+        int s2 = !IsTransparent(volume.Get(side2[0], side2[1], side2[2]));
+        int c = !IsTransparent(volume.Get(corner[0], corner[1], corner[2]));
+        ao[q] = static_cast<uint8_t>(s1 && s2 ? 0 : AO_OPEN - (s1 + s2 + c));
     }
 }
 
-// ==================== BUFFER MANAGEMENT ====================
-void CreateBuffer(int width, int height) {
-    if (hBufferDC) {
-        DeleteDC(hBufferDC);
-        hBufferDC = NULL;
+// Copies quadrant-indexed corner AO onto the face's corners, which works for
+// single blocks and for merged rectangles alike
+void ApplyCornerAO(Face& face, const uint8_t ao[4]) {
+    int axis = FaceDirs[face.dir].axis;
+    int uAxis = (axis + 1) % 3;
+    int vAxis = (axis + 2) % 3;
+    float minU = AxisValue(face.corners[0], uAxis), minV = AxisValue(face.corners[0], vAxis);
+    for (int i = 1; i < 4; i++) {
+        minU = std::min(minU, AxisValue(face.corners[i], uAxis));
+        minV = std::min(minV, AxisValue(face.corners[i], vAxis));
     }
-    if (hBufferBitmap) {
-        DeleteObject(hBufferBitmap);
-        hBufferBitmap = NULL;
+    for (int i = 0; i < 4; i++) {
+        int q = (AxisValue(face.corners[i], uAxis) > minU) | (AxisValue(face.corners[i], vAxis) > minV) << 1;
+        face.ao[i] = ao[q];
     }
-
-    HDC hdc = GetDC(g_hwnd);
-    hBufferDC = CreateCompatibleDC(hdc);
-    hBufferBitmap = CreateCompatibleBitmap(hdc, width, height);
-    SelectObject(hBufferDC, hBufferBitmap);
-    ReleaseDC(g_hwnd, hdc);
-
-    bufferWidth = width;
-    bufferHeight = height;
 }
 
-void ClearBuffer(COLORREF color) {
-    if (!hBufferDC) return;
+// Appends the exposed faces of one block or LOD cell. (lx, ly, lz) index the
+// volume, (x, y, z) are the world coordinates of its low corner and scale its
+// edge length in blocks.
+void CollectFaces(std::vector<Face>& faces, const MeshVolume& volume, int lx, int ly, int lz,
+                  int x, int y, int z, int scale) {
+    BlockType type = volume.Get(lx, ly, lz);
+    if (type == BlockType::BLOCK_AIR) return;
 
-    RECT rc = { 0, 0, bufferWidth, bufferHeight };
-    HBRUSH hBrush = CreateSolidBrush(color);
-    FillRect(hBufferDC, &rc, hBrush);
-    DeleteObject(hBrush);
+    Vec3 lo(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+    Vec3 hi = lo + Vec3(static_cast<float>(scale), static_cast<float>(scale), static_cast<float>(scale));
+
+    // Add the faces that can be seen from outside
+    for (int d = 0; d < FACE_COUNT; d++) {
+        const FaceDirInfo& info = FaceDirs[d];
+        int nx = lx + info.dx, ny = ly + info.dy, nz = lz + info.dz;
+        if (IsFaceVisible(type, volume.Get(nx, ny, nz))) {
+            uint8_t ao[4];
+            FaceCornerAO(volume, d, lx, ly, lz, ao);
+            faces.push_back(MakeBoxFace(static_cast<FaceDir>(d), lo, hi, type, volume.LightAt(nx, ny, nz)));
+            ApplyCornerAO(faces.back(), ao);
+        }
+    }
 }
 
-// ==================== 3D PROJECTION ====================
-POINT Project3DToScreen(float wx, float wy, float wz) {
-    // Simple projection - directly map world coordinates to screen
-    // First, calculate relative position to camera
-    float relX = wx - camera.x;
-    float relY = wy - camera.y;
-    float relZ = wz - camera.z;
-
-    // Apply yaw rotation (horizontal look)
-    float yawRad = camera.yaw * 3.14159f / 180.0f;
-    float tempX = relX * cosf(yawRad) - relZ * sinf(yawRad);
-    float tempZ = relX * sinf(yawRad) + relZ * cosf(yawRad);
-    relX = tempX;
-    relZ = tempZ;
+// Greedy meshing: per direction and slice, exposed faces of the same block type,
+// light level and corner occlusion are merged into the largest rectangles possible. Produces the same surface as
+// CollectFaces with far fewer quads on flat terrain. At LOD levels the volume
+// holds (CHUNK_SIZE >> level) cells per axis, each 2^level blocks wide.
+void GreedyMeshChunk(std::vector<Face>& faces, const MeshVolume& volume, int baseX, int baseY, int baseZ,
+                     int level) {
+    // AO << 16 | light << 8 | type of each exposed face, 0 for none
+    uint32_t mask[CHUNK_SIZE * CHUNK_SIZE];
+    int base[3] = { baseX, baseY, baseZ };
+    int size = CHUNK_SIZE >> level;
+    int scale = 1 << level;
+
+    for (int d = 0; d < FACE_COUNT; d++) {
+        const FaceDirInfo& info = FaceDirs[d];
+        int axis = info.axis;
+        int uAxis = (axis + 1) % 3;
+        int vAxis = (axis + 2) % 3;
+
+        for (int slice = 0; slice < size; slice++) {
+            // Mark exposed faces in this slice
+            int p[3];
+            p[axis] = slice;
+            for (int v = 0; v < size; v++) {
+                p[vAxis] = v;
+                for (int u = 0; u < size; u++) {
+                    p[uAxis] = u;
+                    BlockType type = volume.Get(p[0], p[1], p[2]);
+                    int nx = p[0] + info.dx, ny = p[1] + info.dy, nz = p[2] + info.dz;
+                    if (type == BlockType::BLOCK_AIR || !IsFaceVisible(type, volume.Get(nx, ny, nz))) {
+                        mask[v * size + u] = 0;
+                        continue;
+                    }
+                    uint8_t ao[4];
+                    FaceCornerAO(volume, d, p[0], p[1], p[2], ao);
+                    uint32_t packedAO = ao[0] | ao[1] << 2 | ao[2] << 4 | ao[3] << 6;
+                    mask[v * size + u] = packedAO << 16 | volume.LightAt(nx, ny, nz) << 8 | static_cast<uint32_t>(type);
+                }
+            }
 
-    // Apply pitch rotation (vertical look)
-    float pitchRad = camera.pitch * 3.14159f / 180.0f;
-    float tempY = relY * cosf(pitchRad) - relZ * sinf(pitchRad);
-    tempZ = relY * sinf(pitchRad) + relZ * cosf(pitchRad);
-    relY = tempY;
-    relZ = tempZ;
+            // Grow rectangles: first along u, then along v while whole rows match
+            for (int v = 0; v < size; v++) {
+                for (int u = 0; u < size; ) {
+                    uint32_t key = mask[v * size + u];
+                    if (key == 0) {
+                        u++;
+                        continue;
+                    }
 
-    // Simple perspective projection
-    if (relZ > 0.1f) {
-        float scale = 400.0f / (relZ + 5.0f); // Add some offset to avoid division by small numbers
+                    int width = 1;
+                    while (u + width < size && mask[v * size + u + width] == key) {
+                        width++;
+                    }
 
-        int screenX = bufferWidth / 2 + static_cast<int>(relX * scale);
-        int screenY = bufferHeight / 2 - static_cast<int>(relY * scale);
+                    int height = 1;
+                    for (; v + height < size; height++) {
+                        const uint32_t* row = &mask[(v + height) * size + u];
+                        int k = 0;
+                        while (k < width && row[k] == key) k++;
+                        if (k < width) break;
+                    }
 
-        return { screenX, screenY };
-    }
+                    for (int dv = 0; dv < height; dv++) {
+                        std::fill(&mask[(v + dv) * size + u], &mask[(v + dv) * size + u + width], 0u);
+                    }
 
-    return { -10000, -10000 }; // Behind camera or too close
+                    float lo[3], hi[3];
+                    lo[axis] = static_cast<float>(base[axis] + slice * scale);
+                    hi[axis] = lo[axis] + scale;
+                    lo[uAxis] = static_cast<float>(base[uAxis] + u * scale);
+                    hi[uAxis] = lo[uAxis] + width * scale;
+                    lo[vAxis] = static_cast<float>(base[vAxis] + v * scale);
+                    hi[vAxis] = lo[vAxis] + height * scale;
+
+                    faces.push_back(MakeBoxFace(static_cast<FaceDir>(d), Vec3(lo[0], lo[1], lo[2]),
+                                                Vec3(hi[0], hi[1], hi[2]), static_cast<BlockType>(key & 0xFF),
+                                                static_cast<uint8_t>(key >> 8)));
+                    const uint8_t ao[4] = { static_cast<uint8_t>(key >> 16 & 3), static_cast<uint8_t>(key >> 18 & 3),
+                                            static_cast<uint8_t>(key >> 20 & 3), static_cast<uint8_t>(key >> 22 & 3) };
+                    ApplyCornerAO(faces.back(), ao);
+                    u += width;
+                }
+            }
+        }
+    }
 }
 
-// ==================== RENDER FUNCTIONS ====================
-void DrawFace(HDC hdc, const Face& face) {
-    POINT points[4];
-    bool allVisible = true;
+// Per-worker meshing buffers. A mesh job only touches its worker's scratch
+// and its own chunk, so parallel meshing needs no locks.
+struct MeshScratch {
+    MeshVolume volume;
+    std::vector<Face> faces;
+    std::vector<uint8_t> visited;
+    std::vector<int> stack;
+};
 
-    for (int i = 0; i < 4; i++) {
-        points[i] = Project3DToScreen(face.corners[i].x, face.corners[i].y, face.corners[i].z);
-        if (points[i].x == -10000) {
-            allVisible = false;
-            break;
+// Flood fills the chunk's see-through blocks region by region and links every
+// pair of chunk faces a region touches, so the renderer can tell whether one
+// can be seen through the chunk from another
+void ComputeFaceLinks(Chunk& chunk, const MeshVolume& volume, MeshScratch& scratch) {
+    std::fill(chunk.faceLinks, chunk.faceLinks + FACE_COUNT, 0);
+    chunk.linksDirty = false;
+
+    std::vector<uint8_t>& visited = scratch.visited;
+    std::vector<int>& stack = scratch.stack;
+    visited.assign(CHUNK_VOLUME, 0);
+
+    for (int start = 0; start < CHUNK_VOLUME; start++) {
+        if (visited[start]) continue;
+        visited[start] = 1;
+        if (!IsTransparent(volume.Get(start & CHUNK_MASK, start >> (2 * CHUNK_SHIFT), (start >> CHUNK_SHIFT) & CHUNK_MASK))) {
+            continue;
+        }
+
+        uint8_t touched = 0;
+        stack.clear();
+        stack.push_back(start);
+        while (!stack.empty()) {
+            int index = stack.back();
+            stack.pop_back();
+            int lx = index & CHUNK_MASK, ly = index >> (2 * CHUNK_SHIFT), lz = (index >> CHUNK_SHIFT) & CHUNK_MASK;
+
+            for (int d = 0; d < FACE_COUNT; d++) {
+                const FaceDirInfo& info = FaceDirs[d];
+                int nx = lx + info.dx, ny = ly + info.dy, nz = lz + info.dz;
+                if (nx < 0 || nx >= CHUNK_SIZE || ny < 0 || ny >= CHUNK_SIZE || nz < 0 || nz >= CHUNK_SIZE) {
+                    touched |= 1 << d; // Reached the chunk face on that side
+                    continue;
+                }
+                int next = Chunk::Index(nx, ny, nz);
+                if (visited[next]) continue;
+                visited[next] = 1;
+                if (IsTransparent(volume.Get(nx, ny, nz))) stack.push_back(next);
+            }
+        }
+
+        for (int d = 0; d < FACE_COUNT; d++) {
+            if (touched & (1 << d)) chunk.faceLinks[d] |= touched;
         }
+        if (touched == ALL_FACES) break; // Nothing left to link
     }
+}
 
-    if (!allVisible) return;
+std::vector<std::unique_ptr<MeshScratch>> meshScratch;
+
+// Builds the mesh of the chunk's current level. Blocks that changed since the
+// last build invalidate every level and refresh the face links first.
+void BuildChunkMesh(Chunk& chunk, const ChunkStore& store, MeshScratch& scratch) {
+    bool volumeFilled = false;
+    if (chunk.meshDirty) {
+        FillMeshVolume(scratch.volume, store, chunk.coord);
+        if (chunk.linksDirty) ComputeFaceLinks(chunk, scratch.volume, scratch);
+        for (ChunkMesh& mesh : chunk.meshes) mesh.built = false;
+        chunk.meshDirty = false;
+        volumeFilled = true;
+    }
 
-    if (wireframeMode) {
-        HPEN hPen = CreatePen(PS_SOLID, 1, RGB(100, 100, 100));
-        HPEN hOldPen = (HPEN)SelectObject(hdc, hPen);
-        HBRUSH hOldBrush = (HBRUSH)SelectObject(hdc, GetStockObject(NULL_BRUSH));
+    int level = chunk.lod;
+    if (level == 0) {
+        if (!volumeFilled) FillMeshVolume(scratch.volume, store, chunk.coord);
+    }
+    else {
+        FillLodVolume(scratch.volume, store, chunk, level);
+    }
 
-        Polygon(hdc, points, 4);
+    int baseX = chunk.coord.x * CHUNK_SIZE;
+    int baseY = chunk.coord.y * CHUNK_SIZE;
+    int baseZ = chunk.coord.z * CHUNK_SIZE;
 
-        SelectObject(hdc, hOldPen);
-        SelectObject(hdc, hOldBrush);
-        DeleteObject(hPen);
+    std::vector<Face>& faces = scratch.faces;
+    faces.clear();
+    if (greedyMeshing) {
+        GreedyMeshChunk(faces, scratch.volume, baseX, baseY, baseZ, level);
     }
     else {
-        // Calculate lighting
-        int brightness = face.isTop ? 220 : 180;
-        if (dayNightCycle) {
-            float timeFactor = sinf(timeOfDay * 3.14159f / 12.0f);
-            brightness += static_cast<int>(50.0f * timeFactor);
+        int size = CHUNK_SIZE >> level;
+        int scale = 1 << level;
+        for (int ly = 0; ly < size; ly++) {
+            for (int lz = 0; lz < size; lz++) {
+                for (int lx = 0; lx < size; lx++) {
+                    CollectFaces(faces, scratch.volume, lx, ly, lz,
+                        baseX + lx * scale, baseY + ly * scale, baseZ + lz * scale, scale);
+                }
+            }
         }
+    }
 
-        // Clamp brightness
-        if (brightness < 50) brightness = 50;
-        if (brightness > 255) brightness = 255;
-
-        int r = GetRValue(face.color) * brightness / 255;
-        int g = GetGValue(face.color) * brightness / 255;
-        int b = GetBValue(face.color) * brightness / 255;
+    // Counting sort by direction into the chunk, so whole direction groups can be skipped
+    ChunkMesh& mesh = chunk.meshes[level];
+    int counts[FACE_COUNT] = {};
+    for (const Face& face : faces) counts[face.dir]++;
 
-        COLORREF shadedColor = RGB(r, g, b);
+    mesh.dirStart[0] = 0;
+    for (int d = 0; d < FACE_COUNT; d++) {
+        mesh.dirStart[d + 1] = mesh.dirStart[d] + counts[d];
+    }
 
-        HBRUSH hBrush = CreateSolidBrush(shadedColor);
-        HPEN hPen = CreatePen(PS_SOLID, 1, RGB(r / 2, g / 2, b / 2));
+    int next[FACE_COUNT];
+    std::copy(mesh.dirStart, mesh.dirStart + FACE_COUNT, next);
+    mesh.faces.resize(faces.size());
+    for (const Face& face : faces) mesh.faces[next[face.dir]++] = face;
+
+    // Face corners always land on the chunk's integer lattice
+    mesh.cornerIds.resize(faces.size() * 4);
+    for (size_t i = 0; i < mesh.faces.size(); i++) {
+        for (int c = 0; c < 4; c++) {
+            const Vec3& p = mesh.faces[i].corners[c];
+            mesh.cornerIds[i * 4 + c] = static_cast<uint16_t>(LatticeIndex(
+                static_cast<int>(p.x) - baseX, static_cast<int>(p.y) - baseY, static_cast<int>(p.z) - baseZ));
+        }
+    }
+    mesh.built = true;
+}
 
-        HPEN hOldPen = (HPEN)SelectObject(hdc, hPen);
-        HBRUSH hOldBrush = (HBRUSH)SelectObject(hdc, hBrush);
+// Each level takes over at twice the distance of the one before, so the faces
+// drawn per ring of chunks stay about the same however far the view reaches
+const float LOD_NEAR_DISTANCE = 4.0f; // In chunks, where level 1 starts
+const float LOD_HYSTERESIS = 0.5f;    // In chunks, so a chunk on a boundary doesn't keep switching
 
-        Polygon(hdc, points, 4);
+int SelectLod(int current, float distance) {
+    int level = current;
+    while (level + 1 < LOD_COUNT && distance > LOD_NEAR_DISTANCE * (1 << level) + LOD_HYSTERESIS) level++;
+    while (level > 0 && distance < LOD_NEAR_DISTANCE * (1 << (level - 1)) - LOD_HYSTERESIS) level--;
+    return level;
+}
 
-        SelectObject(hdc, hOldPen);
-        SelectObject(hdc, hOldBrush);
-        DeleteObject(hBrush);
-        DeleteObject(hPen);
+// Meshes a batch of chunks across all job system workers. The world must not
+// be modified while this runs.
+void MeshChunks(const std::vector<Chunk*>& chunks) {
+    while (static_cast<int>(meshScratch.size()) < jobSystem.WorkerCount()) {
+        meshScratch.emplace_back(new MeshScratch());
     }
+
+    jobSystem.ParallelFor(static_cast<int>(chunks.size()), 1, [&chunks](int index, int worker) {
+        BuildChunkMesh(*chunks[index], world, *meshScratch[worker]);
+    });
 }
 
-void CollectFaces(std::vector<Face>& faces, int x, int y, int z, BlockType type) {
-    if (type == BlockType::BLOCK_AIR) return;
+// ==================== RENDER FRAME ====================
+// A face that survived culling, with the slots of its projected corners
+struct DrawItem {
+    const Face* face;
+    int corners[4];
+};
 
-    float fx = static_cast<float>(x);
-    float fy = static_cast<float>(y);
-    float fz = static_cast<float>(z);
-
-    int typeIndex = static_cast<int>(type);
-    COLORREF color = BlockColors[typeIndex];
-
-    // Check which faces are visible (adjacent to air)
-    bool topVisible = (y == WORLD_HEIGHT - 1) || world[x][y + 1][z] == BlockType::BLOCK_AIR;
-    bool frontVisible = (z == WORLD_DEPTH - 1) || world[x][y][z + 1] == BlockType::BLOCK_AIR;
-    bool rightVisible = (x == WORLD_WIDTH - 1) || world[x + 1][y][z] == BlockType::BLOCK_AIR;
-    bool backVisible = (z == 0) || world[x][y][z - 1] == BlockType::BLOCK_AIR;
-    bool leftVisible = (x == 0) || world[x - 1][y][z] == BlockType::BLOCK_AIR;
-    bool bottomVisible = (y == 0) || world[x][y - 1][z] == BlockType::BLOCK_AIR;
-
-    // Calculate depth for sorting (distance from camera to block center)
-    float blockCenterX = fx + 0.5f;
-    float blockCenterY = fy + 0.5f;
-    float blockCenterZ = fz + 0.5f;
-    float dx = blockCenterX - camera.x;
-    float dy = blockCenterY - camera.y;
-    float dz = blockCenterZ - camera.z;
-    float depth = sqrtf(dx * dx + dy * dy + dz * dz);
-
-    // Add visible faces to the list
-    if (topVisible) {
-        Face face;
-        face.corners[0] = Vec3(fx, fy + 1.0f, fz);
-        face.corners[1] = Vec3(fx + 1.0f, fy + 1.0f, fz);
-        face.corners[2] = Vec3(fx + 1.0f, fy + 1.0f, fz + 1.0f);
-        face.corners[3] = Vec3(fx, fy + 1.0f, fz + 1.0f);
-        face.color = color;
-        face.depth = depth;
-        face.isTop = true;
-        faces.push_back(face);
-    }
-
-    if (frontVisible) {
-        Face face;
-        face.corners[0] = Vec3(fx, fy, fz + 1.0f);
-        face.corners[1] = Vec3(fx + 1.0f, fy, fz + 1.0f);
-        face.corners[2] = Vec3(fx + 1.0f, fy + 1.0f, fz + 1.0f);
-        face.corners[3] = Vec3(fx, fy + 1.0f, fz + 1.0f);
-        face.color = color;
-        face.depth = depth;
-        face.isTop = false;
-        faces.push_back(face);
-    }
-
-    if (rightVisible) {
-        Face face;
-        face.corners[0] = Vec3(fx + 1.0f, fy, fz);
-        face.corners[1] = Vec3(fx + 1.0f, fy, fz + 1.0f);
-        face.corners[2] = Vec3(fx + 1.0f, fy + 1.0f, fz + 1.0f);
-        face.corners[3] = Vec3(fx + 1.0f, fy + 1.0f, fz);
-        face.color = color;
-        face.depth = depth;
-        face.isTop = false;
-        faces.push_back(face);
-    }
-
-    if (backVisible) {
-        Face face;
-        face.corners[0] = Vec3(fx, fy, fz);
-        face.corners[1] = Vec3(fx, fy + 1.0f, fz);
-        face.corners[2] = Vec3(fx + 1.0f, fy + 1.0f, fz);
-        face.corners[3] = Vec3(fx + 1.0f, fy, fz);
-        face.color = color;
-        face.depth = depth;
-        face.isTop = false;
-        faces.push_back(face);
-    }
-
-    if (leftVisible) {
-        Face face;
-        face.corners[0] = Vec3(fx, fy, fz);
-        face.corners[1] = Vec3(fx, fy, fz + 1.0f);
-        face.corners[2] = Vec3(fx, fy + 1.0f, fz + 1.0f);
-        face.corners[3] = Vec3(fx, fy + 1.0f, fz);
-        face.color = color;
-        face.depth = depth;
-        face.isTop = false;
-        faces.push_back(face);
+// Everything the 3D image depends on. When none of it moved since the last
+// RenderFrame, the frame buffer already holds the right picture. Anything
+// else RenderFrame, SubmitFace or ShadeFace reads (projection, view, fog
+// table) is derived from these each frame.
+struct FrameInputs {
+    float x, y, z, yaw, pitch, fov;
+    float timeOfDay;
+    int width, height, renderDistance;
+    uint32_t worldRevision;
+    bool fog, wireframe, grid, greedy, occlusion, lod, dayNight;
+
+    bool operator==(const FrameInputs& o) const {
+        return x == o.x && y == o.y && z == o.z && yaw == o.yaw && pitch == o.pitch && fov == o.fov &&
+               timeOfDay == o.timeOfDay && width == o.width && height == o.height &&
+               renderDistance == o.renderDistance && worldRevision == o.worldRevision && fog == o.fog &&
+               wireframe == o.wireframe && grid == o.grid && greedy == o.greedy && occlusion == o.occlusion &&
+               lod == o.lod && dayNight == o.dayNight;
     }
+};
+
+FrameInputs CurrentFrameInputs() {
+    FrameInputs in;
+    in.x = camera.x; in.y = camera.y; in.z = camera.z;
+    in.yaw = camera.yaw; in.pitch = camera.pitch; in.fov = camera.fov;
+    in.timeOfDay = timeOfDay;
+    in.width = bufferWidth; in.height = bufferHeight; in.renderDistance = renderDistance;
+    in.worldRevision = worldRevision;
+    in.fog = fogEnabled; in.wireframe = wireframeMode; in.grid = showGrid;
+    in.greedy = greedyMeshing; in.occlusion = occlusionCulling; in.lod = lodEnabled;
+    in.dayNight = dayNightCycle;
+    return in;
+}
+
+FrameInputs lastFrameInputs;
+bool frameValid = false; // Cleared until the first RenderFrame
+
+bool FrameChanged() {
+    return !frameValid || !(CurrentFrameInputs() == lastFrameInputs);
 }
 
-// ==================== RENDER FRAME ====================
 void RenderFrame() {
-    if (!hBufferDC) return;
+    if (bufferWidth <= 0 || bufferHeight <= 0) return;
 
     // Update FPS counter
     fpsCounter.Update();
+    double frameStart = GetTimeMs();
 
     // Calculate sky color based on time
     COLORREF skyColor;
@@ -520,29 +4236,291 @@ void RenderFrame() {
         skyColor = RGB(10, 20, 40);
     }
 
-    ClearBuffer(skyColor);
+    // Take in streamed chunks (never waits for generation)
+    StreamChunks();
+    double phaseStart = GetTimeMs();
+    frameStats.streamMs = static_cast<float>(phaseStart - frameStart);
+
+    // Streamed chunks are part of this frame, so record the inputs after them
+    lastFrameInputs = CurrentFrameInputs();
+    frameValid = true;
+    frameStats.renderedFrames++;
+
+    frameBuffer.Resize(bufferWidth, bufferHeight);
+    static FrameGeometry geometry;
+    geometry.Clear();
+
+    UpdateProjection();
+    ViewFrustum frustum = BuildFrustum();
+    int visibleChunks = 0, culledChunks = 0, culledFaces = 0, backfacesRejected = 0;
+
+    // Fog fully covers everything from the edge of the view distance, so
+    // chunks and faces beyond it are dropped before any projection work
+    fog.enabled = false;
+    if (fogEnabled) fog.Build(static_cast<float>(renderDistance * CHUNK_SIZE), skyColor);
+    Vec3 eye(camera.x, camera.y, camera.z);
+    int foggedChunks = 0, foggedFaces = 0;
+
+    // Opaque faces go straight from the chunk meshes to the depth-tested
+    // rasterizer; only see-through faces are kept for back-to-front sorting
+    static std::vector<DrawItem> drawList, transparentFaces;
+    static std::vector<DepthKey> transparentOrder;
+    transparentFaces.clear();
+    transparentOrder.clear();
+    drawList.clear();
+    int quadCount = 0;
+
+    // Each lattice corner used by a drawn face is queued for projection once;
+    // latticeStamp tells whether the current chunk already queued it
+    static VertexStream cornerStream;
+    static ProjectedVertices projected;
+    static std::vector<uint32_t> latticeStamp(LATTICE_VOLUME, 0);
+    static std::vector<int> latticeSlot(LATTICE_VOLUME, 0);
+    static uint32_t stamp = 0;
+    cornerStream.Clear();
+
+    // Only chunks within renderDistance of the camera are visited, so the
+    // cost depends on view distance rather than on how big the world is
+    ChunkCoord center = ChunkStore::ToChunkCoord(
+        static_cast<int>(floorf(camera.x)),
+        static_cast<int>(floorf(camera.y)),
+        static_cast<int>(floorf(camera.z)));
+
+    static std::vector<Chunk*> visible, dirty;
+    visible.clear();
+    dirty.clear();
+
+    for (int cx = center.x - renderDistance; cx <= center.x + renderDistance; cx++) {
+        for (int cz = center.z - renderDistance; cz <= center.z + renderDistance; cz++) {
+            for (int cy = center.y - renderDistance; cy <= center.y + renderDistance; cy++) {
+                Chunk* chunk = world.GetChunk({ cx, cy, cz });
+                if (!chunk || chunk->solidCount == 0) continue;
+
+                // Whole chunk outside the view: no meshing, projection or raster
+                Vec3 lo(static_cast<float>(cx * CHUNK_SIZE), static_cast<float>(cy * CHUNK_SIZE),
+                        static_cast<float>(cz * CHUNK_SIZE));
+                Vec3 hi = lo + Vec3(CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE);
+                if (!frustum.IntersectsBox(lo, hi)) {
+                    culledChunks++;
+                    continue;
+                }
+                if (fog.enabled && BoxDistanceSq(lo, hi, eye) >= fog.endSq) {
+                    foggedChunks++;
+                    continue;
+                }
+
+                // Pick the detail level from the distance to the chunk center
+                float dx = lo.x + CHUNK_SIZE * 0.5f - camera.x;
+                float dy = lo.y + CHUNK_SIZE * 0.5f - camera.y;
+                float dz = lo.z + CHUNK_SIZE * 0.5f - camera.z;
+                float distance = sqrtf(dx * dx + dy * dy + dz * dz) / CHUNK_SIZE;
+                chunk->lod = lodEnabled ? SelectLod(chunk->lod, distance) : 0;
+
+                visible.push_back(chunk);
+                if (!chunk->MeshReady()) dirty.push_back(chunk);
+            }
+        }
+    }
+
+    // Mesh everything that changed or switched to an unbuilt level in one parallel batch
+    double meshStart = GetTimeMs();
+    MeshChunks(dirty);
+    frameStats.meshMs = static_cast<float>(GetTimeMs() - meshStart);
+
+    // Walk outwards from the camera chunk, only through chunk faces joined by
+    // see-through blocks and never back towards the camera. Chunks the walk
+    // can't reach are sealed off by solid blocks and are skipped.
+    int occludedChunks = 0;
+    if (occlusionCulling) {
+        struct WalkStep {
+            ChunkCoord coord;
+            int entry;          // Face the walk came in through, -1 at the start
+            uint8_t travelled;  // Directions taken so far
+        };
+
+        int side = 2 * renderDistance + 1;
+        static std::vector<uint8_t> reached, listed;
+        static std::vector<WalkStep> walk;
+        static std::vector<Chunk*> reachable;
+        reached.assign(static_cast<size_t>(side) * side * side, 0);
+        listed.assign(reached.size(), 0);
+        walk.clear();
+        reachable.clear();
+
+        auto cell = [&center, side](const ChunkCoord& c) {
+            return ((c.x - center.x + renderDistance) * side + (c.y - center.y + renderDistance)) * side +
+                   (c.z - center.z + renderDistance);
+        };
+
+        // The walk passes through culled and fogged chunks, but only chunks
+        // that survived those tests (and were meshed) can be drawn
+        for (Chunk* chunk : visible) listed[cell(chunk->coord)] = 1;
+
+        walk.push_back({ center, -1, 0 });
+        reached[cell(center)] = 1;
+        for (size_t head = 0; head < walk.size(); head++) {
+            WalkStep step = walk[head];
+            Chunk* chunk = world.GetChunk(step.coord);
+            if (listed[cell(step.coord)]) reachable.push_back(chunk);
+
+            // Missing and empty chunks let everything through. Chunks changed
+            // since their last mesh (fogged or culled ones are not remeshed)
+            // get their links worked out here, with the idle mesh scratch.
+            uint8_t exits = ALL_FACES;
+            if (chunk && chunk->solidCount > 0 && step.entry >= 0) {
+                if (chunk->linksDirty) {
+                    MeshScratch& scratch = *meshScratch[0];
+                    FillMeshVolume(scratch.volume, world, chunk->coord);
+                    ComputeFaceLinks(*chunk, scratch.volume, scratch);
+                }
+                exits = chunk->faceLinks[step.entry];
+            }
+            for (int d = 0; d < FACE_COUNT; d++) {
+                if (!(exits & (1 << d)) || (step.travelled & (1 << OppositeDir(d)))) continue;
+
+                const FaceDirInfo& info = FaceDirs[d];
+                ChunkCoord next = { step.coord.x + info.dx, step.coord.y + info.dy, step.coord.z + info.dz };
+                if (abs(next.x - center.x) > renderDistance || abs(next.y - center.y) > renderDistance ||
+                    abs(next.z - center.z) > renderDistance) {
+                    continue;
+                }
+                uint8_t& seen = reached[cell(next)];
+                if (seen) continue;
+
+                Vec3 lo(static_cast<float>(next.x * CHUNK_SIZE), static_cast<float>(next.y * CHUNK_SIZE),
+                        static_cast<float>(next.z * CHUNK_SIZE));
+                Vec3 hi = lo + Vec3(CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE);
+                if (!frustum.IntersectsBox(lo, hi)) continue;
 
-    // Collect all visible faces
-    std::vector<Face> faces;
+                seen = 1;
+                walk.push_back({ next, OppositeDir(d), static_cast<uint8_t>(step.travelled | (1 << d)) });
+            }
+        }
+
+        occludedChunks = static_cast<int>(visible.size() - reachable.size());
+        visible.swap(reachable);
+    }
+    visibleChunks = static_cast<int>(visible.size());
+
+    int lodChunks[LOD_COUNT] = {};
+    for (Chunk* chunk : visible) {
+        const ChunkMesh& mesh = chunk->meshes[chunk->lod];
+        lodChunks[chunk->lod]++;
+        if (++stamp == 0) {
+            std::fill(latticeStamp.begin(), latticeStamp.end(), 0);
+            stamp = 1;
+        }
+
+        Vec3 lo(static_cast<float>(chunk->coord.x * CHUNK_SIZE),
+                static_cast<float>(chunk->coord.y * CHUNK_SIZE),
+                static_cast<float>(chunk->coord.z * CHUNK_SIZE));
+        Vec3 hi = lo + Vec3(CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE);
+
+        for (int d = 0; d < FACE_COUNT; d++) {
+            int begin = mesh.dirStart[d], end = mesh.dirStart[d + 1];
+
+            // Camera behind the whole chunk for this direction
+            if (IsBackFacingGroup(static_cast<FaceDir>(d), lo, hi)) {
+                backfacesRejected += end - begin;
+                continue;
+            }
+
+            for (int i = begin; i < end; i++) {
+                const Face& face = mesh.faces[i];
+                if (!FacesCamera(face)) {
+                    backfacesRejected++;
+                    continue;
+                }
+                if (!frustum.IntersectsQuad(face.corners)) {
+                    culledFaces++;
+                    continue;
+                }
+                // Corners 0 and 2 are the face's low and high corners
+                if (fog.enabled && BoxDistanceSq(face.corners[0], face.corners[2], eye) >= fog.endSq) {
+                    foggedFaces++;
+                    continue;
+                }
+
+                DrawItem item;
+                item.face = &face;
+                for (int c = 0; c < 4; c++) {
+                    int id = mesh.cornerIds[i * 4 + c];
+                    if (latticeStamp[id] != stamp) {
+                        latticeStamp[id] = stamp;
+                        latticeSlot[id] = cornerStream.Size();
+                        cornerStream.Push(face.corners[c]);
+                    }
+                    item.corners[c] = latticeSlot[id];
+                }
 
-    // Render from back to front for basic occlusion
-    for (int x = 0; x < WORLD_WIDTH; x++) {
-        for (int z = 0; z < WORLD_DEPTH; z++) {
-            for (int y = 0; y < WORLD_HEIGHT; y++) {
-                CollectFaces(faces, x, y, z, world[x][y][z]);
+                if (IsTransparent(face.type) && !wireframeMode) {
+                    // Distance from the camera to the face center, for sorting
+                    float dx = (face.corners[0].x + face.corners[2].x) * 0.5f - camera.x;
+                    float dy = (face.corners[0].y + face.corners[2].y) * 0.5f - camera.y;
+                    float dz = (face.corners[0].z + face.corners[2].z) * 0.5f - camera.z;
+                    DepthKey key = { FarFirstKey(dx * dx + dy * dy + dz * dz),
+                                     static_cast<uint32_t>(transparentFaces.size()) };
+                    transparentOrder.push_back(key);
+                    transparentFaces.push_back(item);
+                    continue;
+                }
+                drawList.push_back(item);
             }
         }
     }
 
-    // Sort faces by depth (back to front)
-    std::sort(faces.begin(), faces.end());
+    double sortStart = GetTimeMs();
+    frameStats.collectMs = static_cast<float>(sortStart - phaseStart) - frameStats.meshMs;
+
+    // Blended faces still need back to front order, after all opaque ones
+    depthSorter.Sort(transparentOrder);
+    for (const DepthKey& key : transparentOrder) {
+        drawList.push_back(transparentFaces[key.index]);
+    }
+    quadCount = static_cast<int>(drawList.size());
+
+    double projectStart = GetTimeMs();
+    frameStats.sortMs = static_cast<float>(projectStart - sortStart);
 
-    // Draw all faces
-    for (const auto& face : faces) {
-        DrawFace(hBufferDC, face);
+    // Project the shared corners in one SIMD batch, then build triangles
+    ProjectVertices(viewTransform, cornerStream, projected);
+
+    for (const DrawItem& item : drawList) {
+        SubmitFace(geometry, *item.face, projected, item.corners);
+    }
+
+    double rasterStart = GetTimeMs();
+    frameStats.projectMs = static_cast<float>(rasterStart - projectStart);
+
+    // Clear and fill the frame, tile by tile across all workers
+    tileRasterizer.Draw(frameBuffer, geometry, ToPixel(skyColor));
+    frameStats.rasterMs = static_cast<float>(GetTimeMs() - rasterStart);
+
+    frameStats.quads = quadCount;
+    frameStats.projectedCorners = cornerStream.Size();
+    frameStats.visibleChunks = visibleChunks;
+    frameStats.culledChunks = culledChunks;
+    frameStats.occludedChunks = occludedChunks;
+    frameStats.foggedChunks = foggedChunks;
+    frameStats.foggedFaces = foggedFaces;
+    std::copy(lodChunks, lodChunks + LOD_COUNT, frameStats.lodChunks);
+    frameStats.culledFaces = culledFaces;
+    frameStats.backfacesRejected = backfacesRejected;
+    frameStats.renderMs = static_cast<float>(GetTimeMs() - frameStart);
+}
+
+// Renders only when something the image depends on changed; otherwise the
+// previous frame buffer is reused and counted as skipped
+bool RenderFrameIfChanged() {
+    if (!FrameChanged()) {
+        frameStats.skippedFrames++;
+        return false;
     }
+    RenderFrame();
+    return true;
 }
 
+#ifdef _WIN32
 // ==================== UI RENDERING ====================
 void DrawUI(HDC hdc) {
     HFONT hFont = CreateFont(16, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
@@ -602,20 +4580,71 @@ void DrawUI(HDC hdc) {
     sprintf_s(buffer, "Time: %02d:00", static_cast<int>(timeOfDay) % 24);
     TextOutA(hdc, bufferWidth - 100, 60, buffer, static_cast<int>(strlen(buffer)));
 
+    // Draw terrain generation speed
+    sprintf_s(buffer, "Terrain: %.0f chunks/s", terrainStats.chunks * 1000.0 / std::max(terrainStats.ms, 0.001));
+    TextOutA(hdc, bufferWidth - 170, 80, buffer, static_cast<int>(strlen(buffer)));
+
+    sprintf_s(buffer, "View: %d chunks  Loading: %d", renderDistance, chunkStreamer.Pending());
+    TextOutA(hdc, bufferWidth - 170, 100, buffer, static_cast<int>(strlen(buffer)));
+
+    if (worldSnapshot.NodeCount() > 0) {
+        sprintf_s(buffer, "DAG: %d nodes, %.0f KB, %.0f ms", worldSnapshot.NodeCount(),
+            worldSnapshot.MemoryBytes() / 1024.0, snapshotBuildMs);
+        TextOutA(hdc, bufferWidth - 170, 120, buffer, static_cast<int>(strlen(buffer)));
+    }
+
+    if (fogEnabled) {
+        sprintf_s(buffer, "Fogged: %d chunks, %d faces", frameStats.foggedChunks, frameStats.foggedFaces);
+    }
+    else {
+        sprintf_s(buffer, "Fog: off");
+    }
+    TextOutA(hdc, bufferWidth - 170, 160, buffer, static_cast<int>(strlen(buffer)));
+
+    if (lodEnabled) {
+        sprintf_s(buffer, "LOD chunks: %d / %d / %d / %d", frameStats.lodChunks[0], frameStats.lodChunks[1],
+            frameStats.lodChunks[2], frameStats.lodChunks[3]);
+    }
+    else {
+        sprintf_s(buffer, "LOD: off");
+    }
+    TextOutA(hdc, bufferWidth - 170, 140, buffer, static_cast<int>(strlen(buffer)));
+
+    sprintf_s(buffer, "Frames: %d rendered, %d skipped", frameStats.renderedFrames, frameStats.skippedFrames);
+    TextOutA(hdc, bufferWidth - 170, 180, buffer, static_cast<int>(strlen(buffer)));
+
+    sprintf_s(buffer, "Water: %d active cells", waterFlow.ActiveCount());
+    TextOutA(hdc, bufferWidth - 170, 200, buffer, static_cast<int>(strlen(buffer)));
+
+    // Draw mesh stats
+    sprintf_s(buffer, "Mesh: %s  Quads: %d  Corners: %d  Render: %.2f ms",
+        greedyMeshing ? "Greedy" : "Per-face", frameStats.quads, frameStats.projectedCorners, frameStats.renderMs);
+    TextOutA(hdc, previewX + blockSize + 10, previewY + 60, buffer, static_cast<int>(strlen(buffer)));
+
+    sprintf_s(buffer, "Chunks: %d drawn, %d culled, %d occluded  Faces culled: %d  Backfaces: %d",
+        frameStats.visibleChunks, frameStats.culledChunks, frameStats.occludedChunks,
+        frameStats.culledFaces, frameStats.backfacesRejected);
+    TextOutA(hdc, previewX + blockSize + 10, previewY + 80, buffer, static_cast<int>(strlen(buffer)));
+
     // Draw controls
     const char* controls[] = {
         "CONTROLS:",
         "WASD - Move, QE - Up/Down",
         "Arrow Keys - Look around",
         "Right Click - Toggle Mouse Look",
-        "1-9 - Select Block",
+        "0-9 - Select Block",
         "G - Toggle Grid, F - Toggle Fog",
         "R - Wireframe, T - Day/Night",
+        "M - Toggle Greedy Meshing",
+        "+/- - Render Distance",
+        "O - Build Octree Snapshot, P - Restore It",
+        "C - Toggle Occlusion Culling",
+        "L - Toggle Level of Detail",
         "SPACE - Place, SHIFT - Destroy",
         "ESC - Exit"
     };
 
-    for (int i = 0; i < 9; i++) {
+    for (int i = 0; i < static_cast<int>(sizeof(controls) / sizeof(controls[0])); i++) {
         TextOutA(hdc, 20, 20 + i * 20, controls[i], static_cast<int>(strlen(controls[i])));
     }
 
@@ -700,6 +4729,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     switch (uMsg) {
     case WM_CREATE: {
         g_hwnd = hwnd;
+        jobSystem.Start();
         GenerateWorld();
         CreateBuffer(800, 600);
         SetTimer(hwnd, 1, 16, NULL); // ~60 FPS
@@ -722,8 +4752,9 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         PAINTSTRUCT ps;
         HDC hdc = BeginPaint(hwnd, &ps);
 
-        // Render 3D world to buffer
-        RenderFrame();
+        // Render 3D world (if anything changed) and copy it into the GDI buffer
+        RenderFrameIfChanged();
+        PresentFrameBuffer(hBufferDC);
 
         // Draw UI on top
         DrawUI(hBufferDC);
@@ -745,7 +4776,17 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             timeOfDay += 0.016f;
             if (timeOfDay >= 24.0f) timeOfDay -= 24.0f;
         }
-        InvalidateRect(hwnd, NULL, FALSE);
+
+        // Moving water steps at a fixed rate; settled water leaves nothing active
+        static double lastWaterTick = 0.0;
+        if (waterFlow.ActiveCount() > 0 && GetTimeMs() - lastWaterTick >= WATER_TICK_MS) {
+            lastWaterTick = GetTimeMs();
+            waterFlow.Tick();
+        }
+
+        // Idle ticks repaint nothing, so a still view costs almost no CPU
+        StreamChunks();
+        if (FrameChanged()) InvalidateRect(hwnd, NULL, FALSE);
         return 0;
     }
 
@@ -774,34 +4815,49 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         case '7': selectedBlock = static_cast<int>(BlockType::BLOCK_SAND); break;
         case '8': selectedBlock = static_cast<int>(BlockType::BLOCK_GLASS); break;
         case '9': selectedBlock = static_cast<int>(BlockType::BLOCK_BRICK); break;
+        case '0': selectedBlock = static_cast<int>(BlockType::BLOCK_LAMP); break;
 
         case 'G': showGrid = !showGrid; break;
         case 'F': fogEnabled = !fogEnabled; break;
         case 'R': wireframeMode = !wireframeMode; break;
         case 'T': dayNightCycle = !dayNightCycle; break;
+        case 'M':
+            greedyMeshing = !greedyMeshing;
+            world.MarkAllMeshesDirty();
+            break;
 
-        case VK_SPACE: {
-            int placeX = static_cast<int>(camera.x);
-            int placeY = static_cast<int>(camera.y);
-            int placeZ = static_cast<int>(camera.z);
+        case 'C': occlusionCulling = !occlusionCulling; break;
+        case 'L': lodEnabled = !lodEnabled; break;
+
+        case 'O': {
+            double start = GetTimeMs();
+            worldSnapshot.BuildFromStore(world);
+            snapshotBuildMs = GetTimeMs() - start;
+            break;
+        }
+
+        case 'P': RestoreSnapshot(); break;
 
-            if (placeX >= 0 && placeX < WORLD_WIDTH &&
-                placeY >= 0 && placeY < WORLD_HEIGHT &&
-                placeZ >= 0 && placeZ < WORLD_DEPTH) {
-                world[placeX][placeY][placeZ] = static_cast<BlockType>(selectedBlock);
+        case VK_OEM_PLUS:
+            renderDistance = std::min(renderDistance + 1, MAX_RENDER_DISTANCE);
+            break;
+        case VK_OEM_MINUS:
+            renderDistance = std::max(renderDistance - 1, MIN_RENDER_DISTANCE);
+            break;
+
+        case VK_SPACE: {
+            // Place against the face of the block under the crosshair
+            RayHit hit;
+            if (RaycastBlocks(world, ViewRay(PICK_DISTANCE), hit) && (hit.nx | hit.ny | hit.nz)) {
+                EditBlock(hit.x + hit.nx, hit.y + hit.ny, hit.z + hit.nz, static_cast<BlockType>(selectedBlock));
             }
             break;
         }
 
         case VK_SHIFT: {
-            int destroyX = static_cast<int>(camera.x);
-            int destroyY = static_cast<int>(camera.y);
-            int destroyZ = static_cast<int>(camera.z);
-
-            if (destroyX >= 0 && destroyX < WORLD_WIDTH &&
-                destroyY >= 0 && destroyY < WORLD_HEIGHT &&
-                destroyZ >= 0 && destroyZ < WORLD_DEPTH) {
-                world[destroyX][destroyY][destroyZ] = BlockType::BLOCK_AIR;
+            RayHit hit;
+            if (RaycastBlocks(world, ViewRay(PICK_DISTANCE), hit)) {
+                EditBlock(hit.x, hit.y, hit.z, BlockType::BLOCK_AIR);
             }
             break;
         }
@@ -870,6 +4926,8 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
     case WM_DESTROY: {
         KillTimer(hwnd, 1);
+        SaveWorld();
+        chunkStreamer.Stop();
         if (hBufferDC) DeleteDC(hBufferDC);
         if (hBufferBitmap) DeleteObject(hBufferBitmap);
         PostQuitMessage(0);
@@ -917,4 +4975,270 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR pCmdLine
     }
 
     return 0;
-}
\ No newline at end of file
+}
+#else
+// ==================== HEADLESS ENTRY POINT ====================
+// Without Win32 the renderer runs on its own and writes the frame to a PPM image.
+// Usage: Minecraft [output.ppm] [width] [height] [seed]
+//        Minecraft --bench [frames] [width] [height] [seed]   (JSON report on stdout)
+bool WritePPM(const char* path, const FrameBuffer& fb) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+
+    fprintf(file, "P6\n%d %d\n255\n", fb.width, fb.height);
+    std::vector<unsigned char> row(static_cast<size_t>(fb.width) * 3);
+    for (int y = 0; y < fb.height; y++) {
+        const uint32_t* src = &fb.color[static_cast<size_t>(y) * fb.width];
+        for (int x = 0; x < fb.width; x++) {
+            row[x * 3 + 0] = static_cast<unsigned char>(src[x] >> 16);
+            row[x * 3 + 1] = static_cast<unsigned char>(src[x] >> 8);
+            row[x * 3 + 2] = static_cast<unsigned char>(src[x]);
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+// Scripted camera benchmark: a fixed circle over the terrain, so runs with the
+// same seed, size and frame count see the same frames and can be compared
+const float BENCH_RADIUS = 48.0f;       // Blocks from the start position
+const float BENCH_ALTITUDE = 12.0f;     // Blocks above the ground under the camera
+const float BENCH_TURNS = 1.0f;         // Laps of the circle over the whole run
+
+double Percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) return 0.0;
+    std::sort(samples.begin(), samples.end());
+    size_t rank = static_cast<size_t>(ceil(p * samples.size()));
+    return samples[std::min(std::max<size_t>(rank, 1), samples.size()) - 1];
+}
+
+void PrintTimingJson(const char* name, const std::vector<double>& samples, bool last) {
+    double sum = 0.0;
+    for (double ms : samples) sum += ms;
+    printf("    \"%s\": { \"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f }%s\n",
+        name, sum / std::max<size_t>(samples.size(), 1), Percentile(samples, 0.50), Percentile(samples, 0.95),
+        Percentile(samples, 0.99), Percentile(samples, 1.0), last ? "" : ",");
+}
+
+int RunBenchmark(int frames) {
+    jobSystem.Start();
+    GenerateWorld(false); // Pure seed terrain, whatever saves lie around
+
+    const float centerX = camera.x;
+    const float centerZ = camera.z;
+    enum Phase { PHASE_FRAME, PHASE_STREAM, PHASE_MESH, PHASE_COLLECT, PHASE_SORT,
+                 PHASE_PROJECT, PHASE_RASTER, PHASE_COUNT };
+    static const char* PhaseNames[PHASE_COUNT] = { "frame_ms", "stream_ms", "mesh_ms", "collect_ms",
+                                                   "sort_ms", "project_ms", "raster_ms" };
+    std::vector<double> timings[PHASE_COUNT];
+    double quads = 0.0, visibleChunks = 0.0;
+
+    for (int frame = 0; frame < frames; frame++) {
+        float angle = 2.0f * 3.14159f * BENCH_TURNS * frame / frames;
+        camera.x = centerX + BENCH_RADIUS * sinf(angle);
+        camera.z = centerZ + BENCH_RADIUS * cosf(angle);
+        camera.y = TerrainHeight(static_cast<int>(floorf(camera.x)), static_cast<int>(floorf(camera.z)),
+                                 worldSeed) + BENCH_ALTITUDE;
+        camera.yaw = angle * 180.0f / 3.14159f + 90.0f; // Along the circle
+        camera.pitch = -20.0f + 10.0f * sinf(angle * 3.0f);
+
+        // Terrain generation is not what is measured: fill the view first
+        while (StreamChunks() > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        RenderFrame();
+        timings[PHASE_FRAME].push_back(frameStats.renderMs);
+        timings[PHASE_STREAM].push_back(frameStats.streamMs);
+        timings[PHASE_MESH].push_back(frameStats.meshMs);
+        timings[PHASE_COLLECT].push_back(frameStats.collectMs);
+        timings[PHASE_SORT].push_back(frameStats.sortMs);
+        timings[PHASE_PROJECT].push_back(frameStats.projectMs);
+        timings[PHASE_RASTER].push_back(frameStats.rasterMs);
+        quads += frameStats.quads;
+        visibleChunks += frameStats.visibleChunks;
+    }
+
+    printf("{\n");
+    printf("  \"seed\": %u,\n  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n", worldSeed,
+        bufferWidth, bufferHeight, frames);
+    printf("  \"render_distance\": %d,\n  \"workers\": %d,\n", renderDistance, jobSystem.WorkerCount());
+    printf("  \"mean_quads\": %.1f,\n  \"mean_visible_chunks\": %.1f,\n", quads / std::max(frames, 1),
+        visibleChunks / std::max(frames, 1));
+    printf("  \"timings\": {\n");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        PrintTimingJson(PhaseNames[phase], timings[phase], phase == PHASE_COUNT - 1);
+    }
+    printf("  }\n}\n");
+    return 0;
+}
+
+void PrintUsage() {
+    fprintf(stderr, "Usage: Minecraft [output.ppm] [width] [height] [seed]\n"
+                    "       Minecraft --bench [frames] [width] [height] [seed]\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        int frames = argc > 2 ? std::max(atoi(argv[2]), 1) : 300;
+        if (argc > 4) {
+            bufferWidth = atoi(argv[3]);
+            bufferHeight = atoi(argv[4]);
+            if (bufferWidth <= 0 || bufferHeight <= 0) {
+                PrintUsage();
+                return 1;
+            }
+        }
+        if (argc > 5) {
+            worldSeed = static_cast<uint32_t>(strtoul(argv[5], NULL, 10));
+        }
+        return RunBenchmark(frames);
+    }
+
+    const char* outputPath = argc > 1 ? argv[1] : "frame.ppm";
+    if (argc > 3) {
+        bufferWidth = atoi(argv[2]);
+        bufferHeight = atoi(argv[3]);
+        if (bufferWidth <= 0 || bufferHeight <= 0) {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (argc > 4) {
+        worldSeed = static_cast<uint32_t>(strtoul(argv[4], NULL, 10));
+    }
+
+    jobSystem.Start();
+    GenerateWorld();
+
+    // Let the streamer fill the view before rendering the single frame
+    double streamStart = GetTimeMs();
+    while (StreamChunks() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    printf("Streamed %d chunks on %d threads in %.2f ms (%.0f chunks/s per thread, seed %u)\n",
+        terrainStats.chunks, chunkStreamer.ThreadCount(), GetTimeMs() - streamStart,
+        terrainStats.chunks * 1000.0 / std::max(terrainStats.ms, 0.001), worldSeed);
+    printf("Lit %d columns in %.2f ms on the streaming threads, joined in %.2f ms on the UI thread "
+        "(%.3f ms per column)\n", lightStats.columns, lightStats.ms, lightStats.joinMs,
+        lightStats.joinMs / std::max(lightStats.columns, 1));
+
+    size_t blockBytes = 0, lightBytes = 0;
+    world.ForEachChunk([&blockBytes, &lightBytes](Chunk& chunk) {
+        blockBytes += chunk.blocks.MemoryBytes();
+        lightBytes += chunk.LightBytes();
+    });
+    size_t chunkCount = std::max<size_t>(world.ChunkCount(), 1);
+    printf("Block storage: %.1f KB for %d chunks (%d bytes per chunk, %d of them light; %d unpacked)\n",
+        (blockBytes + lightBytes) / 1024.0, static_cast<int>(world.ChunkCount()),
+        static_cast<int>((blockBytes + lightBytes) / chunkCount), static_cast<int>(lightBytes / chunkCount),
+        static_cast<int>(CHUNK_VOLUME * (sizeof(BlockType) + sizeof(uint8_t))));
+
+    double snapshotStart = GetTimeMs();
+    worldSnapshot.BuildFromStore(world);
+    printf("Octree DAG: %d nodes, %.1f KB, built in %.2f ms\n", worldSnapshot.NodeCount(),
+        worldSnapshot.MemoryBytes() / 1024.0, GetTimeMs() - snapshotStart);
+
+    // Dig a pit under the camera, then undo it from the snapshot
+    int pitX = static_cast<int>(floorf(camera.x)), pitZ = static_cast<int>(floorf(camera.z));
+    int pitY = TerrainHeight(pitX, pitZ, worldSeed);
+    for (int dy = -4; dy <= 0; dy++) {
+        for (int dz = -4; dz <= 4; dz++) {
+            for (int dx = -4; dx <= 4; dx++) EditBlock(pitX + dx, pitY + dy, pitZ + dz, BlockType::BLOCK_AIR);
+        }
+    }
+    double restoreStart = GetTimeMs();
+    int restoredChunks = RestoreSnapshot();
+    printf("Snapshot restore: %d chunks rewritten and relit in %.2f ms\n", restoredChunks,
+        GetTimeMs() - restoreStart);
+
+    // Ray casting microbenchmark: a fan of rays across the view, cast against
+    // the chunk store in one batch and one by one against the snapshot
+    std::vector<Ray> rays;
+    const int RAY_GRID = 256;
+    for (int j = 0; j < RAY_GRID; j++) {
+        for (int i = 0; i < RAY_GRID; i++) {
+            float yawRad = (camera.yaw + (i - RAY_GRID / 2) * 90.0f / RAY_GRID) * 3.14159f / 180.0f;
+            float pitchRad = (camera.pitch + (j - RAY_GRID / 2) * 90.0f / RAY_GRID) * 3.14159f / 180.0f;
+            Vec3 dir(sinf(yawRad) * cosf(pitchRad), sinf(pitchRad), cosf(yawRad) * cosf(pitchRad));
+            rays.push_back({ Vec3(camera.x, camera.y, camera.z), dir, 64.0f });
+        }
+    }
+    std::vector<RayHit> hits;
+    double rayStart = GetTimeMs();
+    int rayHits = RaycastBatch(world, rays, hits);
+    double rayMs = GetTimeMs() - rayStart;
+    double dagStart = GetTimeMs();
+    int dagHits = 0;
+    for (const Ray& ray : rays) {
+        RayHit hit;
+        dagHits += worldSnapshot.Raycast(ray.origin, ray.dir, ray.maxDistance, hit);
+    }
+    printf("Raycast: %d rays, %d hits in %.2f ms (%.2f Mrays/s); octree DAG %d hits in %.2f ms\n",
+        static_cast<int>(rays.size()), rayHits, rayMs, rays.size() / std::max(rayMs, 0.001) / 1000.0,
+        dagHits, GetTimeMs() - dagStart);
+
+    // Depth sort microbenchmark: the radix sort against a comparison sort on
+    // the same keys, at a size well past what a frame normally produces
+    const int SORT_KEYS = 131072;
+    std::vector<DepthKey> sortKeys(SORT_KEYS);
+    uint32_t sortState = worldSeed;
+    for (int i = 0; i < SORT_KEYS; i++) {
+        sortState = sortState * 1664525u + 1013904223u;
+        sortKeys[i] = { FarFirstKey((sortState >> 8) * (4096.0f / 16777216.0f)), static_cast<uint32_t>(i) };
+    }
+    std::vector<DepthKey> comparisonKeys = sortKeys;
+    std::vector<DepthKey> warmupKeys = sortKeys;
+    depthSorter.Sort(warmupKeys); // Scratch stays allocated between frames
+    double radixStart = GetTimeMs();
+    depthSorter.Sort(sortKeys);
+    double radixMs = GetTimeMs() - radixStart;
+    double comparisonStart = GetTimeMs();
+    std::sort(comparisonKeys.begin(), comparisonKeys.end(),
+              [](const DepthKey& a, const DepthKey& b) { return a.key < b.key; });
+    printf("Depth sort: %d keys, radix %.3f ms, std::sort %.3f ms\n", SORT_KEYS, radixMs,
+        GetTimeMs() - comparisonStart);
+
+    // Mesh the whole world up front so the load cost can be read separately
+    std::vector<Chunk*> allChunks;
+    world.ForEachChunk([&allChunks](Chunk& chunk) { allChunks.push_back(&chunk); });
+    double meshStart = GetTimeMs();
+    MeshChunks(allChunks);
+    printf("Meshed %d chunks on %d workers in %.2f ms\n", static_cast<int>(allChunks.size()),
+        jobSystem.WorkerCount(), GetTimeMs() - meshStart);
+
+    RenderFrame();
+
+    // Nothing moved, so asking again reuses the frame instead of drawing it
+    double idleStart = GetTimeMs();
+    RenderFrameIfChanged();
+    double idleMs = GetTimeMs() - idleStart;
+
+    if (!WritePPM(outputPath, frameBuffer)) {
+        fprintf(stderr, "Could not write %s\n", outputPath);
+        return 1;
+    }
+
+    printf("Rendered %dx%d, %d quads (%d corners) in %.2f ms (%d chunks drawn, %d culled, %d occluded, "
+        "%d faces culled, %d backfaces rejected) -> %s\n",
+        bufferWidth, bufferHeight, frameStats.quads, frameStats.projectedCorners, frameStats.renderMs,
+        frameStats.visibleChunks, frameStats.culledChunks, frameStats.occludedChunks, frameStats.culledFaces,
+        frameStats.backfacesRejected, outputPath);
+    printf("Fogged out: %d chunks, %d faces\n", frameStats.foggedChunks, frameStats.foggedFaces);
+    printf("Frames: %d rendered, %d skipped (unchanged frame checked in %.3f ms)\n", frameStats.renderedFrames,
+        frameStats.skippedFrames, idleMs);
+    printf("LOD chunks drawn: %d / %d / %d / %d\n", frameStats.lodChunks[0], frameStats.lodChunks[1],
+        frameStats.lodChunks[2], frameStats.lodChunks[3]);
+
+    // Water flow: pour a source above the ground in front of the camera and
+    // tick until it settles (after the frame, so the image is unaffected)
+    int pourX = static_cast<int>(floorf(camera.x)) + 5, pourZ = static_cast<int>(floorf(camera.z)) + 3;
+    EditBlock(pourX, TerrainHeight(pourX, pourZ, worldSeed) + 6, pourZ, BlockType::BLOCK_WATER);
+    while (waterFlow.ActiveCount() > 0) waterFlow.Tick();
+    printf("Water: settled in %d ticks, %d cell updates in %.2f ms (%.2f us per cell)\n", waterStats.ticks,
+        waterStats.cellsUpdated, waterStats.ms, waterStats.ms * 1000.0 / std::max(waterStats.cellsUpdated, 1));
+    return 0;
+}
+#endif